@@ -0,0 +1,21 @@
+#ifndef INCLUDE_SP140_ALLOC_TRACKER_H_
+#define INCLUDE_SP140_ALLOC_TRACKER_H_
+
+#include <Arduino.h>
+
+#include "sp140/structs.h"
+
+// Heap allocation tracker, built with -DALLOC_TRACKER (see platformio.ini).
+// Counts every malloc/calloc/realloc and operator new, and records where the
+// ones after setup() came from. Call sites are return addresses, look them
+// up with addr2line against firmware.elf.
+
+// End of setup(): every allocation from now on is a violation
+void lockAllocations();
+
+const STR_ALLOC_STATS& getAllocStats();
+
+// Print the call sites of violations
+void printAllocSites(Print* out);
+
+#endif  // INCLUDE_SP140_ALLOC_TRACKER_H_
@@ -6,7 +6,8 @@
 // Set up the barometer
 void setupAltimeter();
 
-// Get the altitude (in meters)
+// Get the latest altitude (in meters). Never waits on the I2C bus, the
+// reading is refreshed in the background.
 float getAltitude(const STR_DEVICE_DATA_140_V1& deviceData);
 
 #endif  // INCLUDE_SP140_ALTIMETER_H_
@@ -0,0 +1,27 @@
+#ifndef INCLUDE_SP140_BATTERY_H_
+#define INCLUDE_SP140_BATTERY_H_
+
+#include "sp140/structs.h"
+
+// Battery model and remaining flight time.
+//
+// The pack voltage only gives a good state of charge at rest. After a few
+// seconds at low current, the remaining energy is set to batt_size times
+// that state of charge. Under load it counts down with the energy the ESC
+// reports. The minutes remaining are that energy over the average power of
+// the last FLIGHT_TIME_WINDOW seconds.
+
+#define FLIGHT_TIME_WINDOW  60  // s
+
+// Map pack voltage (0.01 V) to state of charge, 0-100%
+uint8_t getBatteryPercent(uint16_t centiVolts);
+
+// Update with a fresh ESC packet, O(1). battWattHours is batt_size.
+void updateFlightTime(const STR_ESC_TELEMETRY_140& telemetry, uint16_t battWattHours);
+
+// Forget the average power, e.g. when a flight starts
+void resetFlightTimeWindow();
+
+const STR_FLIGHT_TIME_ESTIMATE& getFlightTimeEstimate();
+
+#endif  // INCLUDE_SP140_BATTERY_H_
@@ -0,0 +1,15 @@
+#ifndef INCLUDE_SP140_BENCHMARK_H_
+#define INCLUDE_SP140_BENCHMARK_H_
+
+#include <Arduino.h>
+
+// Microbenchmarks of the hot paths, built with -DBENCHMARK (see platformio.ini).
+// Each function is called repeatedly and timed per call: in CPU cycles with
+// SysTick on the controller, in ns on the host (native-bench). Results are
+// printed as CSV lines starting with "bench,", one per function:
+//   bench,version,platform,function,unit,runs,min,median,max
+
+// Run every benchmark and print the results. Call at the end of setup().
+void runBenchmarks(Print* out);
+
+#endif  // INCLUDE_SP140_BENCHMARK_H_
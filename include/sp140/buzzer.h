@@ -3,14 +3,29 @@
 
 #include <stdint.h>
 
+#include "sp140/structs.h"
+
 // Set up the buzzer
 void setupBuzzer();
 
-// Play a single note
+// Queue a single note (freq 0 = rest). Returns immediately; the note is
+// dropped if 32 notes are already waiting.
 void buzzerNote(uint16_t freq, uint16_t duration);
 
-// Play a sequence of notes
-void buzzerSequence(uint16_t sequence[], int millis);
+// Queue a sequence of eighth notes
+void buzzerSequence(uint16_t sequence[], int len);
 void buzzerSequence(uint16_t freq1, uint16_t freq2 = 0, uint16_t freq3 = 0);
 
+// Queue a melody of notes with their own durations, e.g. an alarm pattern
+void buzzerMelody(const STR_NOTE melody[], int len);
+
+// Take the next queued note, for whatever plays them. False if there is none.
+bool popBuzzerNote(STR_NOTE* note);
+
+#ifdef RP_PIO
+// Play queued notes on core1: ends the current note once it is over and starts
+// the next one. Never waits. Returns false if it didn't start a note.
+bool playBuzzerNotes();
+#endif
+
 #endif  // INCLUDE_SP140_BUZZER_H_
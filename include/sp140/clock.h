@@ -0,0 +1,27 @@
+#ifndef INCLUDE_SP140_CLOCK_H_
+#define INCLUDE_SP140_CLOCK_H_
+
+#include <stdint.h>
+
+// CPU clock scaling (RP2040). The controller idles at CLOCK_IDLE_KHZ while
+// disarmed and runs at CLOCK_ARMED_KHZ while flying.
+//
+// The peripheral clock (UART, SPI) is kept on the 48 MHz USB PLL, so their
+// baud rates never change. I2C, PIO (Servo, tone) and SysTick run from the
+// CPU clock. The I2C bus sets its baud rate again before its next job, on
+// core1, the ESC Servo is set up again by the caller.
+
+#define CLOCK_IDLE            0
+#define CLOCK_ARMED           1
+
+// Move the peripheral clock to the USB PLL. Call before any peripheral starts.
+void setupClock();
+
+// Switch to a profile. Returns true if the clock changed, and the
+// clock-derived peripherals outside this module need to be set up again.
+bool setClockProfile(uint8_t profile);
+
+// The CPU clock now
+uint32_t getCpuKhz();
+
+#endif  // INCLUDE_SP140_CLOCK_H_
@@ -0,0 +1,18 @@
+#ifndef INCLUDE_SP140_COBS_H_
+#define INCLUDE_SP140_COBS_H_
+
+#include <stdint.h>
+
+// Consistent Overhead Byte Stuffing. Encoded data contains no zero bytes, so
+// 0x00 can delimit frames. Encoding adds at most one byte per 254.
+#define COBS_MAX_ENCODED_SIZE(len)  ((len) + (len) / 254 + 1)
+
+// Encode len bytes into out (at least COBS_MAX_ENCODED_SIZE(len) bytes).
+// Returns the encoded size, without a delimiter.
+uint16_t cobsEncode(const uint8_t* in, uint16_t len, uint8_t* out);
+
+// Decode len bytes (without the delimiter) into out, which may be the same
+// buffer as in. Returns the decoded size, or 0 if the data is malformed.
+uint16_t cobsDecode(const uint8_t* in, uint16_t len, uint8_t* out);
+
+#endif  // INCLUDE_SP140_COBS_H_
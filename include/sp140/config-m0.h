@@ -10,7 +10,11 @@
 #define LED_3         38  // output for LED 3
 #define THROTTLE_PIN  A0  // throttle pot input
 
-#define SerialESC     Serial5  // ESC UART connection
+// The single ESC: the UART of its telemetry and the pin of its throttle output
+#define ESC_COUNT     1
+#define ESC_SERIALS   {&Serial5}
+#define ESC_PINS      {12}
+#define ESC_TRIMS     {0}  // us added to the throttle pulse
 
 // SP140
 #define POT_PIN       A0
@@ -18,7 +22,14 @@
 #define TFT_CS        10
 #define TFT_DC        11
 #define TFT_LITE      A1
-#define ESC_PIN       12
 #define ENABLE_VIB    true    // enable vibration
 
+// The M0 always runs at 48 MHz
+#define CLOCK_IDLE_KHZ    48000
+#define CLOCK_ARMED_KHZ   48000
+
+// Code always runs from flash on the M0
+#define RAM_FUNC(name)      name
+#define SCRATCH_DATA(name)
+
 #endif  // INCLUDE_SP140_CONFIG_M0_H_
@@ -8,7 +8,15 @@
 #define LED_SW        12  // output for LED
 #define THROTTLE_PIN  A0  // throttle pot input
 
-#define SerialESC     Serial1  // ESC UART connection
+// ESCs: the UART of their telemetry and the pin of their throttle output.
+// Twin-motor frames build with -DESC_COUNT=2 and use the first two. Further
+// ESCs can use PIO UARTs (SerialPIO).
+#ifndef ESC_COUNT
+  #define ESC_COUNT   1
+#endif
+#define ESC_SERIALS   {&Serial1, &Serial2}  // Serial2 is UART1 on its default pins
+#define ESC_PINS      {14, 6}
+#define ESC_TRIMS     {0, 0}  // us added to each motor's throttle pulse
 
 // SP140
 #define POT_PIN       A0
@@ -16,7 +24,22 @@
 #define TFT_CS        13
 #define TFT_DC        11
 #define TFT_LITE      25
-#define ESC_PIN       14
 #define ENABLE_VIB    false    // enable vibration
 
+// CPU clock profiles. Armed is the clock validated for RFI tolerance (see
+// board_build.f_cpu). Idle runs from the USB PLL and stops the system PLL.
+#define CLOCK_IDLE_KHZ    48000
+#define CLOCK_ARMED_KHZ   80000
+
+// Built with -DHOT_PATHS_IN_RAM, the safety-critical hot paths run from SRAM and
+// their tables live in scratch memory, so they never stall on XIP cache misses.
+#ifdef HOT_PATHS_IN_RAM
+  #include <pico/platform.h>
+  #define RAM_FUNC(name)      __not_in_flash_func(name)
+  #define SCRATCH_DATA(name)  __scratch_x(name)
+#else
+  #define RAM_FUNC(name)      name
+  #define SCRATCH_DATA(name)
+#endif
+
 #endif  // INCLUDE_SP140_CONFIG_RP2040_H_
@@ -12,6 +12,21 @@
 
 #define ENABLE_BUZ            true  // enable buzzer
 
+#define ESC_DISARMED_PWM      1010
+#define ESC_MIN_PWM           1030  // ESC min is 1050
+#define ESC_MAX_PWM           1990  // ESC max 1950
+
+// Throttle limiter, closed loop on the ESC telemetry. The power limit comes
+// down linearly from LIMIT_WATTS to LIMIT_MIN_WATTS as the ESC heats up from
+// LIMIT_DERATE_DECI_C to LIMIT_MAX_DECI_C.
+#define LIMIT_CENTIAMPS       18000  // 180 A
+#define LIMIT_WATTS           15000
+#define LIMIT_MIN_WATTS       4500   // Never lower, the ESC cuts out by itself when it overheats
+#define LIMIT_DERATE_DECI_C   900    // 90 C
+#define LIMIT_MAX_DECI_C      1100   // 110 C
+
+#define FLIGHT_LOG_INTERVAL   0  // ms between flight log records, 0 = every ESC packet (~50 Hz)
+
 #ifdef M0_PIO
   #include "sp140/config-m0.h"      // device config
 #else
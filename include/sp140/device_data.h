@@ -3,16 +3,29 @@
 
 #include "sp140/structs.h"
 
-// Set up the EEPROM, etc.
+// Set up the journal and recover the latest saved data
 void setupDeviceData();
 
-// Write deviceData to EEPROM
+// Commit queued writes and compact the journal in the background.
+// May stall for a flash erase, so call only while disarmed and idle.
+void serviceDeviceData();
+
+// Commit any queued write immediately (e.g. before a reboot)
+void flushDeviceData();
+
+// Queue deviceData for writing. Repeated writes are coalesced into one commit.
 void writeDeviceData(STR_DEVICE_DATA_140_V1* d);
 
-// Reset deviceData to factory defaults and write to EEPROM
+// Reset deviceData to factory defaults and queue it for writing
 void resetDeviceData(STR_DEVICE_DATA_140_V1* d);
 
-// Read saved data from EEPROM
+// Read saved data, including any write that is still queued
 void refreshDeviceData(STR_DEVICE_DATA_140_V1* d);
 
+// Commit counts and durations
+const STR_PERSIST_STATS& getPersistStats();
+
+// CRC16 (XMODEM)
+uint16_t crc16(const uint8_t* buf, uint32_t size);
+
 #endif  // INCLUDE_SP140_DEVICE_DATA_H_
@@ -3,10 +3,32 @@
 
 #include "sp140/structs.h"
 
+#define ESC_PACKET_SIZE       22
+#define ESC_STALE_MILLIS      2000  // No packet for this long: the telemetry is stale
+
 void setupEscTelemetry();
 
+// Decode what the ESCs have sent since the last call. Never waits for data.
 void updateEscTelemetry();
 
+// All ESCs combined: current, power and energy added up, the highest
+// temperature, and the average voltage, rpm and duty of the ESCs with fresh
+// telemetry. lastUpdateMillis is when any of them last sent a packet.
 const STR_ESC_TELEMETRY_140& getEscTelemetry();
 
+// One ESC, 0 to ESC_COUNT - 1
+const STR_ESC_TELEMETRY_140& getEscTelemetry(uint8_t esc);
+
+// The first ESC with stale telemetry, or -1 if all are fresh
+int8_t getStaleEsc(uint32_t nowMillis);
+
+// Forget the telemetry of all ESCs, as at boot, e.g. after the benchmarks parsed made-up packets
+void resetEscTelemetry();
+
+// Parse one 22 byte packet into the telemetry of an ESC. False if it isn't valid.
+bool parseEscSerialData(uint8_t esc, uint8_t buffer[]);
+
+// Fletcher-16 checksum, as used by the ESC packets
+uint16_t checkFletcher16(uint8_t buffer[], int len);
+
 #endif  // INCLUDE_SP140_ESC_TELEMETRY_H_
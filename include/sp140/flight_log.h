@@ -0,0 +1,47 @@
+#ifndef INCLUDE_SP140_FLIGHT_LOG_H_
+#define INCLUDE_SP140_FLIGHT_LOG_H_
+
+#include "sp140/structs.h"
+
+#define FLIGHT_LOG_MAGIC    0x4C465053  // "SPFL"
+#define FLIGHT_LOG_VERSION  2  // Records encoded with log_codec
+
+// Mount the filesystem (RP2040 only) and find the next flight number
+void setupFlightLog();
+
+// Start recording a new flight. Doesn't touch flash or the filesystem,
+// a flight still being copied from the staging area just waits.
+void startFlightLog();
+
+// Stop recording. The flight is copied to its file after landing.
+void stopFlightLog();
+
+// Queue a record, rate limited to FLIGHT_LOG_INTERVAL.
+// Never touches flash; the record is dropped if the buffer is full.
+void logFlightRecord(const STR_FLIGHT_RECORD_140& record);
+
+// While flying, move buffered records to pre-erased staging flash, at most one page per call.
+// Disarmed, copy staged flights into their files and erase staging space for the next flight.
+void serviceFlightLog();
+
+const STR_FLIGHT_LOG_STATS& getFlightLogStats();
+
+// Oldest and newest flight files that can be downloaded. False if there are none.
+// Flights still in staging flash are not counted until they are copied.
+bool getFlightRange(uint32_t* oldest, uint32_t* newest);
+
+// True while landed flights are still waiting in staging flash to be copied into files
+bool isFlightCopyPending();
+
+// Look up the summary of a flight in the catalog with a single seek.
+// Summaries are kept after the flight file itself has been deleted.
+bool getFlightSummary(uint32_t flightNumber, STR_FLIGHT_CATALOG_ENTRY* entry);
+
+// Read part of a finished flight file (flight 0 = the catalog).
+// Returns the number of bytes read (0 at the end), or -1 if there is no such file.
+int32_t readFlightFile(uint32_t flightNumber, uint32_t offset, uint8_t* buf, uint32_t len);
+
+// Size of a finished flight file (flight 0 = the catalog), or -1 if there is no such file
+int32_t getFlightFileSize(uint32_t flightNumber);
+
+#endif  // INCLUDE_SP140_FLIGHT_LOG_H_
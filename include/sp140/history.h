@@ -0,0 +1,45 @@
+#ifndef INCLUDE_SP140_HISTORY_H_
+#define INCLUDE_SP140_HISTORY_H_
+
+#include "sp140/structs.h"
+
+// Telemetry history, kept as a decimation pyramid of min/max/average
+// buckets. Level 0 has 1 s buckets. Each level above has one bucket for
+// several of the level below: 10 s, 1 min and 10 min. Adding a sample and
+// closing a bucket are O(1), and the whole flight fits in fixed memory.
+
+#define HISTORY_POWER         0  // W
+#define HISTORY_ALTITUDE      1  // m
+#define HISTORY_VOLTS         2  // 0.01 V
+#define HISTORY_TEMPERATURE   3  // 0.1 C, ESC
+#define HISTORY_SERIES        4
+
+#define HISTORY_LEVELS        4
+#ifdef M0_PIO
+  #define HISTORY_SLOTS       30  // Buckets kept per level
+#else
+  #define HISTORY_SLOTS       60
+#endif
+
+// Forget all samples, e.g. when a flight starts
+void resetHistory();
+
+// Add a sample to the open 1 s bucket of a series (clamped to int16)
+void addHistorySample(uint8_t series, int32_t value);
+
+// Close the buckets whose time is up. Call at least once a second.
+void updateHistory();
+
+// Length of a bucket in a level
+uint32_t getHistoryBucketMillis(uint8_t level);
+
+// Number of closed buckets in a level, up to HISTORY_SLOTS
+uint8_t getHistoryCount(uint8_t level);
+
+// A closed bucket of a level, age 0 = the newest
+const STR_HISTORY_BUCKET& getHistoryBucket(uint8_t series, uint8_t level, uint8_t age);
+
+// The finest level that still holds every bucket since the reset
+uint8_t getHistoryLevel();
+
+#endif  // INCLUDE_SP140_HISTORY_H_
@@ -0,0 +1,24 @@
+#ifndef INCLUDE_SP140_I2C_BUS_H_
+#define INCLUDE_SP140_I2C_BUS_H_
+
+#include <stdint.h>
+
+// Shared I2C bus (BMP388 altimeter, DRV2605 haptics). Drivers post jobs that
+// do their bus transfers, and the jobs run one at a time where no time-critical
+// thread waits on them: on core1 on the RP2040 (a BMP388 reading blocks for
+// about 20 ms), otherwise in a low priority thread between throttle runs.
+
+typedef void (*I2cJobFunction)(void* context);
+
+// Queue a job: run does the transfers, done (optional) is called right after
+// it completes, on the same core. Call from core0 only. Never blocks.
+// Returns false if the queue is full.
+bool postI2cJob(I2cJobFunction run, I2cJobFunction done = nullptr, void* context = nullptr);
+
+// Let serviceI2cBus() run jobs. Call at the end of setup(), which still uses the bus.
+void startI2cBus();
+
+// Run the next queued job, if any. Returns false if there was none.
+bool serviceI2cBus();
+
+#endif  // INCLUDE_SP140_I2C_BUS_H_
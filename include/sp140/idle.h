@@ -0,0 +1,18 @@
+#ifndef INCLUDE_SP140_IDLE_H_
+#define INCLUDE_SP140_IDLE_H_
+
+#include <stdint.h>
+
+// Tickless idle for the main loop (core 0). Instead of polling the tasks,
+// the core sleeps until the next task is due. Any interrupt (UART, USB,
+// GPIO) wakes it early. The time asleep is reported to the profiler as
+// idle time, the CPU headroom.
+
+// Claim the wake-up alarm (RP2040)
+void setupIdle();
+
+// Sleep until the millisecond wakeMillis starts, or an interrupt arrives.
+// Returns right away if wakeMillis has already started.
+void idleUntil(uint32_t wakeMillis);
+
+#endif  // INCLUDE_SP140_IDLE_H_
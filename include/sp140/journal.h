@@ -0,0 +1,42 @@
+#ifndef INCLUDE_SP140_JOURNAL_H_
+#define INCLUDE_SP140_JOURNAL_H_
+
+#include <stdint.h>
+
+// Log-structured, wear-leveled record journal for a small fixed-size image.
+//
+// The journal region is split into sectors which are used round-robin. Each
+// sector starts with a header and a full snapshot of the image, followed by
+// small records holding only the bytes that changed. When a sector fills up
+// the latest image is compacted into the next sector, so every sector is
+// erased equally often and the old sector stays valid until the new one is.
+
+#define JOURNAL_MAX_IMAGE_SIZE  64
+
+// Set up the storage that backs the journal
+void setupJournal();
+
+// Recover the latest valid image. Returns false if the journal is empty.
+bool journalMount(uint8_t* image, uint8_t size);
+
+// Copy the last persisted image (no storage access). Returns false if not mounted.
+bool journalRead(uint8_t* image, uint8_t size);
+
+// Append the bytes of image that differ from the last persisted image
+bool journalWrite(const uint8_t* image, uint8_t size);
+
+// True if the active sector is nearly full (or damaged) and should be compacted
+bool journalNeedsCompaction();
+
+// Copy the latest image into a fresh sector
+bool journalCompact();
+
+// Read the image stored before the journal existed (raw bytes at offset 0)
+void journalReadLegacy(uint8_t* image, uint8_t size);
+
+#ifdef RP_PIO
+// Flash offset of the journal. Program flash below it is free for others.
+uint32_t getJournalFlashOffset();
+#endif
+
+#endif  // INCLUDE_SP140_JOURNAL_H_
@@ -0,0 +1,39 @@
+#ifndef INCLUDE_SP140_LOG_CODEC_H_
+#define INCLUDE_SP140_LOG_CODEC_H_
+
+#include <stdint.h>
+
+#include "sp140/structs.h"
+
+// Compact flight log encoding.
+//
+// Every field of STR_FLIGHT_RECORD_140 is stored as an integer in its own
+// fixed-point unit, energy rounded to 10 mWh and altitude to 0.1 m. Each
+// frame starts with a 16-bit little-endian field mask. A keyframe (mask bit
+// 15 set) holds every field as an absolute value. The frames in between hold
+// only the fields that changed, as deltas from the previous frame. All values
+// are zig-zag varints, so a typical delta frame is about 12 bytes instead of 36.
+
+#define LOG_CODEC_FIELD_COUNT         13
+#define LOG_CODEC_KEYFRAME            0x8000
+#define LOG_CODEC_KEYFRAME_INTERVAL   50  // frames, about 1 s at the ESC packet rate
+#define LOG_CODEC_MAX_FRAME_SIZE      (2 + 5 * LOG_CODEC_FIELD_COUNT)
+
+typedef struct {
+  int32_t prev[LOG_CODEC_FIELD_COUNT];  // Quantized values of the previous frame
+  uint16_t sinceKeyframe;
+} STR_LOG_CODEC_STATE;
+
+// Reset the state, so the next frame is a keyframe
+void resetLogCodec(STR_LOG_CODEC_STATE* state);
+
+// Encode record into out (at least LOG_CODEC_MAX_FRAME_SIZE bytes).
+// Returns the frame size.
+uint8_t encodeFlightRecord(STR_LOG_CODEC_STATE* state, const STR_FLIGHT_RECORD_140& record, uint8_t* out);
+
+// Decode one frame from in. Returns the number of bytes consumed, or 0 if the
+// frame is truncated or there was no keyframe yet.
+uint8_t decodeFlightRecord(STR_LOG_CODEC_STATE* state, const uint8_t* in, uint32_t len,
+                           STR_FLIGHT_RECORD_140* record);
+
+#endif  // INCLUDE_SP140_LOG_CODEC_H_
@@ -0,0 +1,50 @@
+#ifndef INCLUDE_SP140_PROFILER_H_
+#define INCLUDE_SP140_PROFILER_H_
+
+#include <stdint.h>
+
+#include "sp140/structs.h"
+
+// Sampling profiler and CPU load meter.
+//
+// The main loop brackets every task (thread) it runs, which gives the run time
+// per task and the busy time of core 0. Core 1 reports its own busy time, and
+// the idle sleep of core 0 its time asleep. The load of each core is
+// recomputed every second.
+//
+// On the RP2040 a timer interrupt also samples the interrupted pc of core 0,
+// and the task it belongs to, into a histogram. Sampling is off until started
+// over WebUSB. Download the snapshot as file DOWNLOAD_PROFILE and symbolize it
+// with tools/profiler against firmware.elf.
+
+#define PROFILER_TASK_LOOP   0   // Outside of any task: the scheduler itself
+#define PROFILER_MAX_TASKS   16  // Including PROFILER_TASK_LOOP
+
+// Name the tasks 1..count, for the snapshot
+void setupProfiler(const char* const taskNames[], uint8_t count);
+
+// Restart the profile, sampling at sampleHz (0 = stop sampling)
+void startProfiler(uint16_t sampleHz);
+
+// Bracket a task run on core 0
+void profilerTaskBegin(uint8_t task);
+void profilerTaskEnd();
+
+// Report time core 1 spent busy
+void recordCpuBusy(uint8_t core, uint32_t micros);
+
+// Report time core 0 spent asleep
+void recordCpuIdle(uint32_t micros);
+
+// Update the load once a second. Call from the main loop.
+void updateCpuLoad();
+const STR_CPU_LOAD& getCpuLoad();
+
+// Read part of the snapshot, taken when offset is 0.
+// Returns the number of bytes read, 0 at the end.
+int32_t readProfile(uint32_t offset, uint8_t* buf, uint32_t len);
+
+// Size of the last snapshot
+uint32_t getProfileSize();
+
+#endif  // INCLUDE_SP140_PROFILER_H_
@@ -5,16 +5,17 @@
 
 #pragma pack(push, 1)
 
-// ESC telemetry
-typedef struct {
-  float volts;
-  float temperatureC;
-  float amps;
-  float watts;
-  float wattHours;
-  float rpm;
-  float inPWM;
-  float outPWM;
+// ESC telemetry, in fixed-point units (the M0 has no FPU).
+// Convert to float only to show values to people.
+typedef struct {
+  uint16_t centiVolts;      // 0.01 V, averaged over the last 50 packets
+  int16_t deciCelsius;      // 0.1 C
+  int32_t centiAmps;        // 0.01 A
+  int32_t watts;
+  int32_t milliwattHours;   // energy used since power on
+  uint32_t rpm;
+  uint16_t inPWM;
+  uint16_t outPWM;
   // Status Flags
   // # Bit position in byte indicates flag set, 1 is set, 0 is default
   // # Bit 0: Motor Started, set when motor is running as expected
@@ -46,7 +47,228 @@ typedef struct {
   uint16_t crc;              // crc
 } STR_DEVICE_DATA_140_V1;
 
-// Note struct (passed between rp2040 cores)
+// Device data persistence statistics
+typedef struct {
+  uint32_t commits;     // journal writes and compactions
+  uint32_t coalesced;   // writes merged into an already pending commit
+  uint32_t failures;
+  uint32_t lastMicros;  // duration of the last commit
+  uint32_t maxMicros;   // longest commit since boot
+} STR_PERSIST_STATS;
+
+// Loop timing measurement
+typedef struct {
+  uint32_t lastStartMicros;
+  uint32_t maxRunMicros;       // longest single run
+  uint32_t maxIntervalMicros;  // longest gap between the starts of two runs
+  uint32_t runs;
+} STR_LOOP_TIMING;
+
+// Throttle limiter state
+#define LIMIT_CURRENT      0x01
+#define LIMIT_POWER        0x02
+#define LIMIT_TEMPERATURE  0x04  // the power limit is derated
+typedef struct {
+  uint16_t capPermille;   // highest throttle allowed, of the range above ESC_MIN_PWM (1000 = no cap)
+  uint8_t active;         // LIMIT_* holding the throttle back
+  int32_t wattLimit;      // after thermal derating
+} STR_THROTTLE_LIMIT;
+
+// Flight log state flags
+#define FLIGHT_FLAG_ARMED            0x01
+#define FLIGHT_FLAG_CRUISING         0x02
+#define FLIGHT_FLAG_THROTTLE_ACTIVE  0x04
+#define FLIGHT_FLAG_ESC_STALE        0x08
+#define FLIGHT_FLAG_FAILSAFE         0x10  // throttle cut after a missed deadline
+#define FLIGHT_FLAG_LIMITED          0x20  // throttle held back by the limiter
+
+// Flight log file header, at the start of every flight file
+typedef struct {
+  uint32_t magic;         // FLIGHT_LOG_MAGIC
+  uint8_t version;        // FLIGHT_LOG_VERSION
+  uint8_t recordSize;     // sizeof(STR_FLIGHT_RECORD_140) before encoding
+  uint16_t intervalMs;    // configured record interval, 0 = every ESC packet
+  uint32_t flightNumber;
+  uint32_t startMillis;   // millis() at arming
+  uint8_t version_major;  // firmware version
+  uint8_t version_minor;
+} STR_FLIGHT_LOG_HEADER;
+
+// Flight log record (stored encoded, see log_codec.h)
+typedef struct {
+  uint32_t millis;
+  uint16_t throttlePWM;   // commanded ESC pulse width (us)
+  uint16_t centiVolts;    // ESC telemetry, units as in STR_ESC_TELEMETRY_140
+  int16_t deciCelsius;
+  int32_t centiAmps;
+  int32_t watts;
+  int32_t milliwattHours;  // stored with 10 mWh resolution
+  uint32_t rpm;
+  uint16_t inPWM;
+  uint16_t outPWM;
+  uint8_t statusFlag;     // ESC status flags, see STR_ESC_TELEMETRY_140
+  float altitude;         // meters above ground
+  uint8_t stateFlags;     // FLIGHT_FLAG_*
+} STR_FLIGHT_RECORD_140;
+
+// Flight catalog entry. Entry n-1 of the catalog file summarizes flight n.
+typedef struct {
+  uint32_t flightNumber;    // 0 = no entry
+  uint32_t startMillis;     // millis() at arming
+  uint32_t durationMillis;
+  uint32_t records;
+  float wattHours;          // energy used during the flight
+  float peakWatts;
+  float maxTemperatureC;    // ESC temperature
+  uint32_t dataOffset;      // first record in the flight file (after the header)
+  uint32_t dataBytes;       // size of the encoded records
+  uint16_t crc;
+} STR_FLIGHT_CATALOG_ENTRY;
+
+// WebUSB download chunk: this header, length data bytes, then the crc16
+// (little-endian) of the header and data.
+#define DOWNLOAD_CHUNK_MAGIC  0xD1
+#define DOWNLOAD_NO_FILE      0xFFFFFFFF  // offset of the end chunk if there is no such file
+#define DOWNLOAD_PROFILE      0xFFFFFFFF  // flightNumber of the profiler snapshot (see profiler.h)
+typedef struct {
+  uint8_t magic;          // DOWNLOAD_CHUNK_MAGIC
+  uint32_t flightNumber;  // 0 = the flight catalog
+  uint32_t offset;        // of the data in the file
+  uint16_t length;        // 0 = end of file, offset is then the file size
+} STR_DOWNLOAD_CHUNK_HEADER;
+
+// Binary config protocol over WebUSB. Each frame is [type][seq][payload][crc16 lo][crc16 hi],
+// crc16 over type, seq and payload, COBS encoded and delimited by 0x00 on both sides.
+// Replies echo the seq of the request.
+#define CONFIG_PROTOCOL_VERSION   1
+#define CONFIG_MSG_GET            0x01  // request the config, no payload
+#define CONFIG_MSG_SET            0x02  // STR_CONFIG_MSG_140, read-only fields are ignored
+#define CONFIG_MSG_REBOOT_BL      0x03  // reboot to the bootloader, no reply
+#define CONFIG_MSG_LIVE           0x04  // uint16 sample interval in ms, 0 = stop streaming, no reply
+#define CONFIG_MSG_PROFILE        0x05  // uint16 sample rate in Hz, 0 = stop, restarts the profile, no reply
+#define CONFIG_MSG_FLIGHT_TIME    0x06  // request the flight time estimate, no payload
+#define CONFIG_MSG_CONFIG         0x81  // reply to GET and SET: STR_CONFIG_MSG_140
+#define CONFIG_MSG_LIVE_DATA      0x82  // STR_FLIGHT_RECORD_140 samples encoded with log_codec,
+                                        // seq counts packets, a gap means packets were dropped
+#define CONFIG_MSG_FLIGHT_TIME_DATA 0x83  // reply to FLIGHT_TIME: STR_FLIGHT_TIME_ESTIMATE,
+                                          // also sent once a second while streaming LIVE_DATA
+#define CONFIG_MSG_ERROR          0xFF  // reply: one CONFIG_ERROR_* byte
+#define CONFIG_ERROR_FRAME        1     // bad COBS, crc or length
+#define CONFIG_ERROR_TYPE         2     // unknown message type
+#define CONFIG_ARCH_SAMD21        1
+#define CONFIG_ARCH_RP2040        2
+typedef struct {
+  uint8_t protocol;          // CONFIG_PROTOCOL_VERSION, read-only
+  uint8_t version_major;     // read-only
+  uint8_t version_minor;     // read-only
+  uint8_t arch;              // CONFIG_ARCH_*, read-only
+  uint16_t armed_seconds;    // read-only
+  uint8_t screen_rotation;
+  float sea_pressure;
+  uint8_t metric_temp;
+  uint8_t metric_alt;
+  uint8_t performance_mode;
+  uint16_t batt_size;
+  uint8_t btn_mode;
+  uint8_t device_id[16];     // chip serial number, zero padded, read-only
+} STR_CONFIG_MSG_140;
+
+// Flight log statistics
+typedef struct {
+  uint32_t flightNumber;   // current (or last) flight file
+  uint32_t records;        // records queued this flight
+  uint32_t dropped;        // records lost because the buffer was full
+  uint32_t bytesWritten;   // bytes written to flash this flight
+  uint32_t maxWriteMicros;  // longest single flash write this flight
+} STR_FLIGHT_LOG_STATS;
+
+// WebUSB transmit queue statistics
+typedef struct {
+  uint32_t depth;            // bytes waiting to be sent
+  uint32_t maxDepth;
+  uint32_t sentBytes;
+  uint32_t droppedBytes;     // messages that didn't fit in the queue
+  uint32_t droppedMessages;
+} STR_USB_TX_STATS;
+
+// Heap allocation tracking
+typedef struct {
+  uint32_t allocations;    // since boot
+  uint32_t bytes;
+  uint32_t violations;     // allocations after setup()
+  uint32_t untrackedSites;  // violations whose call site didn't fit the table
+} STR_ALLOC_STATS;
+
+typedef struct {
+  uint32_t pc;  // return address of the allocation call
+  uint32_t count;
+  uint32_t bytes;
+} STR_ALLOC_SITE;
+
+// CPU load, busy time in 0.1% of each core over the last second
+typedef struct {
+  uint16_t busyPermille[2];
+  uint16_t peakBusyPermille[2];  // highest since the profile was started
+  uint16_t idlePermille;         // core 0 asleep, waiting for the next task: the headroom
+  uint16_t minIdlePermille;      // lowest since the profile was started
+} STR_CPU_LOAD;
+
+// Profiler snapshot, downloaded as a file: this header, taskCount
+// STR_PROFILE_TASK, then slotCount STR_PROFILE_SLOT sorted by pc.
+#define PROFILE_MAGIC      0x46505053  // "SPPF"
+#define PROFILE_VERSION    2
+#define PROFILE_TASK_NAME  12
+typedef struct {
+  uint32_t magic;            // PROFILE_MAGIC
+  uint8_t version;           // PROFILE_VERSION
+  uint8_t version_major;     // firmware, to match the ELF
+  uint8_t version_minor;
+  uint8_t taskCount;
+  uint16_t slotCount;
+  uint16_t sampleHz;         // 0 = not sampling
+  uint32_t samples;          // PC samples taken
+  uint32_t droppedSamples;   // samples whose pc didn't fit the table
+  uint32_t durationMillis;   // since the profile was started
+  STR_CPU_LOAD load;
+} STR_PROFILE_HEADER;
+
+typedef struct {
+  char name[PROFILE_TASK_NAME];  // zero padded
+  uint32_t samples;              // PC samples taken while the task ran
+  uint32_t runs;
+  uint32_t busyMillis;           // total run time
+} STR_PROFILE_TASK;
+
+typedef struct {
+  uint32_t pc;
+  uint32_t count;
+} STR_PROFILE_SLOT;
+
+// Deadline supervisor statistics, per task
+typedef struct {
+  uint32_t overruns;           // deadlines missed since boot
+  uint32_t worstGapMillis;     // longest time between two heartbeats
+  uint32_t lastOverrunMillis;  // millis() when the last overrun was detected
+  uint32_t lastGapMillis;      // length of the last overrun, once the task ran again
+} STR_TASK_DEADLINE_STATS;
+
+// Remaining flight time estimate (see battery.h)
+#define FLIGHT_TIME_UNKNOWN  0xFFFF
+typedef struct {
+  uint16_t minutes;                 // at the average power, FLIGHT_TIME_UNKNOWN when gliding or idle
+  uint8_t batteryPercent;           // remaining energy / batt_size
+  int32_t remainingMilliwattHours;
+  int32_t avgWatts;                 // over the sliding window
+} STR_FLIGHT_TIME_ESTIMATE;
+
+// Telemetry history bucket (see history.h). An empty bucket has min > max.
+typedef struct {
+  int16_t min;
+  int16_t max;
+  int16_t avg;
+} STR_HISTORY_BUCKET;
+
+// Note struct (queued for the buzzer)
 typedef union {
   struct fields {
     uint16_t freq;
@@ -0,0 +1,40 @@
+#ifndef INCLUDE_SP140_SUPERVISOR_H_
+#define INCLUDE_SP140_SUPERVISOR_H_
+
+#include <stdint.h>
+
+#include "sp140/structs.h"
+
+// Deadline supervisor for the safety-critical tasks. Each task sends a
+// heartbeat every time it runs. A task without a heartbeat for longer than
+// its deadline has overrun. A timer interrupt checks the deadlines every
+// 10 ms, so the fail-safe runs while the main loop is still stuck. The
+// overrun is logged on the debug serial port, and the alarm sounded, once the
+// main loop runs again. The hardware watchdog is no longer fed until every
+// task is back on time.
+
+#define SUPERVISED_THROTTLE   0
+#define SUPERVISED_ESC        1
+#define SUPERVISED_BUTTON     2
+#define SUPERVISED_TASKS      3
+
+// Supervise a task. failsafe runs once per overrun, in the timer interrupt:
+// it should only set outputs and flags. alarm then runs from the main loop,
+// for anything else. nullptr for both only logs the overrun.
+void superviseTask(uint8_t task, const char* name, uint16_t deadlineMillis, void (*failsafe)(),
+                   void (*alarm)());
+
+// Start checking, at the end of setup(). Every deadline starts now.
+// Claims a hardware alarm on the RP2040, and TCC2 on the M0.
+void startSupervisor();
+
+// The task has just run
+void taskHeartbeat(uint8_t task);
+
+// Log the overruns the timer interrupt found, and sound their alarms. Returns
+// true if all tasks are on time, the only time the hardware watchdog may be fed.
+bool checkTaskDeadlines();
+
+const STR_TASK_DEADLINE_STATS& getTaskDeadlineStats(uint8_t task);
+
+#endif  // INCLUDE_SP140_SUPERVISOR_H_
@@ -0,0 +1,20 @@
+#ifndef INCLUDE_SP140_THROTTLE_LIMIT_H_
+#define INCLUDE_SP140_THROTTLE_LIMIT_H_
+
+#include "sp140/structs.h"
+
+// Caps the throttle against the current, power and ESC temperature limits
+// in config.h, which are per ESC. Each round of fresh ESC packets adjusts the
+// cap, so the throttle follows within a packet or two. While the ESCs are
+// below the limits, or their telemetry is stale, the cap rises back smoothly.
+
+// Lift the cap. Call at arm.
+void resetThrottleLimit();
+
+// Limit a throttle pulse, given the newest telemetry of each of the ESC_COUNT
+// ESCs. The most loaded ESC sets the cap, and every ESC gets the same throttle.
+int limitThrottle(int pwm, const STR_ESC_TELEMETRY_140* const telemetry[]);
+
+const STR_THROTTLE_LIMIT& getThrottleLimit();
+
+#endif  // INCLUDE_SP140_THROTTLE_LIMIT_H_
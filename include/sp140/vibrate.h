@@ -9,7 +9,7 @@ void setupVibrate();
 // Do a default notification vibration.
 void vibrateNotify();
 
-// Do a sequence of vibrations.
+// Do a sequence of vibrations. Queued for the I2C bus, returns immediately.
 void vibrateSequence(uint8_t vibe0, uint8_t vibe1 = 0, uint8_t vibe2 = 0);
 
 #endif  // INCLUDE_SP140_VIBRATE_H_
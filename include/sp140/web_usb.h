@@ -5,7 +5,26 @@
 
 void setupWebUsbSerial(void (*lineStateCallback)(bool connected));
 
+// Replies are queued, and sent by serviceWebUsbTx()
 void sendWebUsbSerial(const STR_DEVICE_DATA_140_V1& deviceData);
 bool parseWebUsbSerial(STR_DEVICE_DATA_140_V1* deviceData);
 
+// Stream a requested flight file in crc16-checked chunks, only as fast as the
+// USB endpoint accepts them. Never blocks. Call only while disarmed.
+void serviceWebUsbDownload();
+void stopWebUsbDownload();
+bool webUsbDownloadActive();
+
+// Live telemetry requested by the host. Queue every sample (never blocks, the
+// requested rate is applied here) and send batched packets from the service
+// call. Packets are dropped when the host falls behind. The flight time
+// estimate is sent along once a second.
+void queueLiveTelemetry(const STR_FLIGHT_RECORD_140& record);
+void serviceWebUsbLive();
+bool webUsbLiveActive();
+
+// Move queued messages to the USB endpoint as far as it has room. Never blocks.
+void serviceWebUsbTx();
+const STR_USB_TX_STATS& getWebUsbTxStats();
+
 #endif  // INCLUDE_SP140_WEB_USB_H_
@@ -0,0 +1,137 @@
+#include "sp140/alloc_tracker.h"
+
+#ifdef ALLOC_TRACKER
+
+#include <hardware/sync.h>
+#include <malloc.h>
+#include <new>
+
+#define ALLOC_SITE_COUNT  16
+
+static STR_ALLOC_STATS allocStats;
+static STR_ALLOC_SITE allocSites[ALLOC_SITE_COUNT];
+static bool locked = false;
+static bool inNew[2] = {false, false};  // Per core: operator new already counted the malloc it makes
+
+static void recordAllocation(void* pc, size_t size) {
+  // Both cores allocate. Striped spin locks are meant for short sections like this one.
+  spin_lock_t* lock = spin_lock_instance(PICO_SPINLOCK_ID_STRIPED_FIRST);
+  const uint32_t irq = spin_lock_blocking(lock);
+  allocStats.allocations++;
+  allocStats.bytes += size;
+  if (locked) {
+    allocStats.violations++;
+    const uint32_t site = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pc));
+    uint8_t i = 0;
+    while (i < ALLOC_SITE_COUNT && allocSites[i].count > 0 && allocSites[i].pc != site) i++;
+    if (i < ALLOC_SITE_COUNT) {
+      allocSites[i].pc = site;
+      allocSites[i].count++;
+      allocSites[i].bytes += size;
+    } else {
+      allocStats.untrackedSites++;  // Table full
+    }
+  }
+  spin_unlock(lock, irq);
+}
+
+// The public entry points, so the return address is the caller's. The core
+// already wraps these with -Wl,--wrap and links cannot stack wrappers, so these
+// replace the core's and keep what they do: keep interrupts off around newlib.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+struct mallinfo __real_mallinfo();
+
+void* __wrap_malloc(size_t size) {
+  if (!inNew[rp2040.cpuid()]) recordAllocation(__builtin_return_address(0), size);
+  noInterrupts();
+  void* ptr = __real_malloc(size);
+  interrupts();
+  return ptr;
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  recordAllocation(__builtin_return_address(0), n * size);
+  noInterrupts();
+  void* ptr = __real_calloc(n, size);
+  interrupts();
+  return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  recordAllocation(__builtin_return_address(0), size);
+  noInterrupts();
+  void* newPtr = __real_realloc(ptr, size);
+  interrupts();
+  return newPtr;
+}
+
+void __wrap_free(void* ptr) {
+  noInterrupts();
+  __real_free(ptr);
+  interrupts();
+}
+
+struct mallinfo __wrap_mallinfo() {
+  noInterrupts();
+  struct mallinfo info = __real_mallinfo();
+  interrupts();
+  return info;
+}
+}  // extern "C"
+
+static void* trackedNew(void* pc, size_t size) {
+  recordAllocation(pc, size);
+  const int core = rp2040.cpuid();
+  inNew[core] = true;
+  void* ptr = malloc(size);
+  inNew[core] = false;
+  return ptr;
+}
+
+void* operator new(size_t size) {
+  return trackedNew(__builtin_return_address(0), size);
+}
+
+void* operator new[](size_t size) {
+  return trackedNew(__builtin_return_address(0), size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void lockAllocations() {
+  locked = true;
+}
+
+const STR_ALLOC_STATS& getAllocStats() {
+  return allocStats;
+}
+
+void printAllocSites(Print* out) {
+  out->printf("heap: %u allocations, %u after setup\n",
+              static_cast<unsigned int>(allocStats.allocations),
+              static_cast<unsigned int>(allocStats.violations));
+  for (uint8_t i = 0; i < ALLOC_SITE_COUNT && allocSites[i].count > 0; i++) {
+    out->printf("  0x%08x: %u allocations, %u bytes\n", static_cast<unsigned int>(allocSites[i].pc),
+                static_cast<unsigned int>(allocSites[i].count), static_cast<unsigned int>(allocSites[i].bytes));
+  }
+}
+
+#endif  // ALLOC_TRACKER
@@ -1,4 +1,5 @@
 #include "sp140/altimeter.h"
+#include "sp140/i2c_bus.h"
 #include "sp140/structs.h"
 
 #include <Adafruit_BMP3XX.h>
@@ -8,14 +9,36 @@ bool bmpPresent = false;
 float groundAltitude = 0;
 int warmupCount = 3;
 
+// Latest reading, updated by a job on the I2C bus (core1 on the RP2040)
+static volatile float lastAltitude = 0;
+static float readAltitude = 0;
+static float seaPressure = 1013.25;
+static volatile bool readPending = false;
+
+static void readAltitudeJob(void* /* context */) {
+  readAltitude = bmp.readAltitude(seaPressure);
+}
+
+static void readAltitudeDone(void* /* context */) {
+  if (warmupCount > 0) {
+    warmupCount--;
+    if (warmupCount == 0) groundAltitude = readAltitude;
+  }
+  lastAltitude = readAltitude;
+  __sync_synchronize();  // Store the reading before asking for the next one
+  readPending = false;
+}
+
+// Returns the latest reading and requests a new one, so this never waits on the bus
 float getAltitude(const STR_DEVICE_DATA_140_V1& deviceData) {
   if (bmpPresent) {
-    const float altitude = bmp.readAltitude(deviceData.sea_pressure);
-    if (warmupCount > 0) {
-      warmupCount--;
-      if (warmupCount == 0) groundAltitude = altitude;
+    if (!readPending) {
+      seaPressure = deviceData.sea_pressure;
+      // Set before posting, the job may finish on the other core right away
+      readPending = true;
+      if (!postI2cJob(readAltitudeJob, readAltitudeDone)) readPending = false;
     }
-    return altitude - groundAltitude;
+    return lastAltitude - groundAltitude;
   }
   return __FLT_MIN__;
 }
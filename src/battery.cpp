@@ -0,0 +1,108 @@
+#include "sp140/battery.h"
+
+#include "sp140/config.h"
+
+#include <Arduino.h>
+
+#define REST_CENTIAMPS    300   // 3 A
+#define REST_MILLIS       3000  // Longer than the voltage average (50 packets)
+#define MIN_AVG_WATTS     300   // Below this the pilot is gliding, no estimate
+
+// Pack voltage (0.01 V) at 0, 10, ... 100% state of charge,
+// a simple set of data points from load testing.
+static const uint16_t kBatteryCentiVolts[] = {
+  6096, 7800, 8016, 8232, 8520, 8760, 8976, 9168, 9336, 9480, 9960
+};
+
+static STR_FLIGHT_TIME_ESTIMATE estimate = {FLIGHT_TIME_UNKNOWN, 0, 0, 0};
+
+// Energy left at the last rest, and the ESC energy counter at that time
+static bool anchored = false;
+static int32_t anchorRemainingMilliwattHours = 0;
+static int32_t anchorUsedMilliwattHours = 0;
+static uint32_t restStartMillis = 0;
+static bool resting = false;
+
+// Average power of each of the last FLIGHT_TIME_WINDOW seconds
+static int32_t windowWatts[FLIGHT_TIME_WINDOW];
+static uint8_t windowHead = 0;
+static uint8_t windowCount = 0;
+static int32_t windowSum = 0;
+static int32_t secondSum = 0;
+static uint16_t secondCount = 0;
+static uint32_t secondStartMillis = 0;
+
+// State of charge in 0.1%, interpolated between the data points
+static uint16_t batteryPermille(uint16_t centiVolts) {
+  if (centiVolts <= kBatteryCentiVolts[0]) return 0;
+  for (uint8_t i = 1; i < sizeof(kBatteryCentiVolts) / sizeof(kBatteryCentiVolts[0]); i++) {
+    const uint16_t low = kBatteryCentiVolts[i - 1];
+    const uint16_t high = kBatteryCentiVolts[i];
+    if (centiVolts <= high) return (i - 1) * 100 + 100 * (centiVolts - low) / (high - low);
+  }
+  return 1000;
+}
+
+uint8_t getBatteryPercent(uint16_t centiVolts) {
+  return batteryPermille(centiVolts) / 10;
+}
+
+void resetFlightTimeWindow() {
+  windowHead = 0;
+  windowCount = 0;
+  windowSum = 0;
+  secondSum = 0;
+  secondCount = 0;
+}
+
+// Close a second of samples: it replaces the oldest second in the window
+static void closeSecond() {
+  const int32_t watts = secondSum / secondCount;
+  if (windowCount == FLIGHT_TIME_WINDOW) {
+    windowSum -= windowWatts[windowHead];
+  } else {
+    windowCount++;
+  }
+  windowWatts[windowHead] = watts;
+  windowSum += watts;
+  windowHead = (windowHead + 1) % FLIGHT_TIME_WINDOW;
+  secondSum = 0;
+  secondCount = 0;
+}
+
+void RAM_FUNC(updateFlightTime)(const STR_ESC_TELEMETRY_140& telemetry, uint16_t battWattHours) {
+  const uint32_t nowMillis = telemetry.lastUpdateMillis;
+  const int32_t capacityMilliwattHours = static_cast<int32_t>(battWattHours) * 1000;
+
+  // Sliding window of average power
+  if (secondCount == 0) secondStartMillis = nowMillis;
+  secondSum += telemetry.watts;
+  secondCount++;
+  if (nowMillis - secondStartMillis >= 1000) closeSecond();
+
+  // Re-anchor to the voltage once the pack has been resting for a while
+  const bool rest = abs(telemetry.centiAmps) < REST_CENTIAMPS;
+  if (rest && !resting) restStartMillis = nowMillis;
+  resting = rest;
+  if (!anchored || (resting && nowMillis - restStartMillis >= REST_MILLIS)) {
+    anchored = true;
+    anchorRemainingMilliwattHours = static_cast<int32_t>(battWattHours) * batteryPermille(telemetry.centiVolts);
+    anchorUsedMilliwattHours = telemetry.milliwattHours;
+  }
+
+  int32_t remaining = anchorRemainingMilliwattHours - (telemetry.milliwattHours - anchorUsedMilliwattHours);
+  remaining = constrain(remaining, 0, capacityMilliwattHours);
+  estimate.remainingMilliwattHours = remaining;
+  estimate.batteryPercent = capacityMilliwattHours > 0 ? remaining / (capacityMilliwattHours / 100) : 0;
+  estimate.avgWatts = windowCount > 0 ? windowSum / windowCount : 0;
+  if (estimate.avgWatts < MIN_AVG_WATTS) {
+    estimate.minutes = FLIGHT_TIME_UNKNOWN;
+  } else {
+    const int32_t minutes = remaining * 60 / (estimate.avgWatts * 1000);  // Fits: batt_size is at most 10 kWh
+    estimate.minutes = min(minutes, static_cast<int32_t>(FLIGHT_TIME_UNKNOWN - 1));
+  }
+}
+
+const STR_FLIGHT_TIME_ESTIMATE& getFlightTimeEstimate() {
+  return estimate;
+}
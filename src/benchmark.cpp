@@ -0,0 +1,226 @@
+#include "sp140/benchmark.h"
+
+#ifdef BENCHMARK
+
+#include "sp140/battery.h"
+#include "sp140/config.h"
+#include "sp140/device_data.h"
+#include "sp140/display.h"
+#include "sp140/esc_telemetry.h"
+#include "sp140/history.h"
+#include "sp140/structs.h"
+#include "sp140/throttle_limit.h"
+#include "sp140/watchdog.h"
+
+#include <CircularBuffer.h>
+
+#define BENCH_RUNS          101  // Odd, so the median is a sample
+#define BENCH_DISPLAY_RUNS  11   // A full render takes tens of ms
+
+#ifdef SIL_PIO
+  #include <chrono>
+  #define BENCH_PLATFORM  "host"
+  #define BENCH_UNIT      "ns"
+#else
+  #define BENCH_UNIT      "cycles"
+  #define CYCLES_PER_MICRO  (F_CPU / 1000000)
+#endif
+
+#ifdef M0_PIO
+  #define BENCH_PLATFORM  "samd21"
+  // SysTick also drives millis(), it wraps every ms
+  #define SYSTICK_VALUE   (SysTick->VAL)
+  #define SYSTICK_RELOAD  (SysTick->LOAD)
+#elif RP_PIO
+  #include <hardware/structs/systick.h>
+  #define BENCH_PLATFORM  "rp2040"
+  // The core doesn't use SysTick, run it free at the CPU clock
+  #define SYSTICK_VALUE   (systick_hw->cvr)
+  #define SYSTICK_RELOAD  (systick_hw->rvr)
+#endif
+
+// Defined in sp140.cpp
+extern CircularBuffer<int, 8> throttlePotBuffer;
+int getAvgPot();
+
+typedef void (*BenchFunction)();
+
+static uint32_t samples[BENCH_RUNS];
+static uint8_t escPacket[22];
+static STR_DEVICE_DATA_140_V1 deviceData;
+static volatile int sink;  // Keeps results from being optimized away
+
+#ifdef SIL_PIO
+static std::chrono::steady_clock::time_point startTime;
+
+static void benchStart() {
+  startTime = std::chrono::steady_clock::now();
+}
+
+static uint32_t benchStop() {
+  const auto elapsed = std::chrono::steady_clock::now() - startTime;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+#else
+static uint32_t startTick;
+static uint32_t startMicros;
+
+static void setupCycleCounter() {
+#ifdef RP_PIO
+  systick_hw->rvr = 0xFFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5;  // Enabled, CPU clock, no interrupt
+#endif
+}
+
+static void benchStart() {
+  startMicros = micros();
+  startTick = SYSTICK_VALUE;
+}
+
+// SysTick counts down. Calls longer than half its period may have wrapped
+// it, those are timed with micros() instead.
+static uint32_t benchStop() {
+  const uint32_t tick = SYSTICK_VALUE;
+  const uint32_t elapsedMicros = micros() - startMicros;
+  const uint32_t period = SYSTICK_RELOAD + 1;
+  if (elapsedMicros >= period / CYCLES_PER_MICRO / 2) return elapsedMicros * CYCLES_PER_MICRO;
+  return (startTick - tick + period) % period;
+}
+#endif  // SIL_PIO
+
+static void sortSamples(uint16_t runs) {
+  for (uint16_t i = 1; i < runs; i++) {
+    const uint32_t sample = samples[i];
+    uint16_t j = i;
+    for (; j > 0 && samples[j - 1] > sample; j--) samples[j] = samples[j - 1];
+    samples[j] = sample;
+  }
+}
+
+// Time runs calls of function. Returns the minimum; the samples stay sorted.
+static uint32_t measure(BenchFunction function, uint16_t runs, uint32_t overhead) {
+  function();  // Warm up caches and lazy state
+  for (uint16_t i = 0; i < runs; i++) {
+    benchStart();
+    function();
+    const uint32_t elapsed = benchStop();
+    samples[i] = elapsed > overhead ? elapsed - overhead : 0;
+    if (i % 16 == 0) resetWatchdog();
+  }
+  sortSamples(runs);
+  return samples[0];
+}
+
+static void runBenchmark(Print* out, const char* name, BenchFunction function, uint16_t runs, uint32_t overhead) {
+  measure(function, runs, overhead);
+  out->printf("bench,%d.%d,%s,%s,%s,%u,%u,%u,%u\n", VERSION_MAJOR, VERSION_MINOR, BENCH_PLATFORM, name, BENCH_UNIT,
+              runs, static_cast<unsigned int>(samples[0]), static_cast<unsigned int>(samples[runs / 2]),
+              static_cast<unsigned int>(samples[runs - 1]));
+}
+
+//
+// Benchmarked calls
+//
+
+static void benchEmpty() {}
+
+static void benchFletcher16() {
+  sink = checkFletcher16(escPacket, sizeof(escPacket) - 4);
+}
+
+static void benchParseEsc() {
+  parseEscSerialData(0, escPacket);
+}
+
+static void benchCrc16() {
+  sink = crc16(reinterpret_cast<const uint8_t*>(&deviceData), sizeof(deviceData) - 2);
+}
+
+static void benchBatteryPercent() {
+  static uint16_t centiVolts = 6000;
+  centiVolts = centiVolts < 10000 ? centiVolts + 37 : 6000;  // Walk through every segment
+  sink = getBatteryPercent(centiVolts);
+}
+
+static void benchFlightTime() {
+  updateFlightTime(getEscTelemetry(), 4000);
+}
+
+static void benchHistorySample() {
+  static int32_t watts = 0;
+  watts = (watts + 997) % 20000;
+  addHistorySample(HISTORY_POWER, watts);
+}
+
+// The same steps as updateThrottle()
+static void benchThrottleMap() {
+  sink = map(getAvgPot(), 0, 4095, 1030, 1990);
+}
+
+// A fresh packet from every ESC, over the power limit, on every call
+static void benchLimitThrottle() {
+  static STR_ESC_TELEMETRY_140 telemetry = {};
+  static const STR_ESC_TELEMETRY_140* escs[ESC_COUNT];
+  static uint32_t calls = 0;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) escs[i] = &telemetry;
+  telemetry.centiAmps = 17000;
+  telemetry.watts = 16000;
+  telemetry.lastUpdateMillis = millis() - 1000 + calls++ % 1000;  // A new time stamp, less than 1 s old
+  sink = limitThrottle(ESC_MAX_PWM, escs);
+}
+
+static void benchUpdateDisplay() {
+  updateDisplay(deviceData, getEscTelemetry(), 123.4, true, false, 0);
+}
+
+// A valid telemetry packet at about 95 V, 60 A and 40 C
+static void makeEscPacket() {
+  memset(escPacket, 0, sizeof(escPacket));
+  const uint16_t rawVolts = 9350;
+  const uint16_t rawTemperature = 2500;
+  const int16_t rawAmps = 750;
+  const uint32_t rawRpm = 4200 * 62;
+  memcpy(escPacket + 0, &rawVolts, 2);
+  memcpy(escPacket + 2, &rawTemperature, 2);
+  memcpy(escPacket + 4, &rawAmps, 2);
+  memcpy(escPacket + 8, &rawRpm, 4);
+  const uint16_t checksum = checkFletcher16(escPacket, sizeof(escPacket) - 4);
+  escPacket[18] = checksum & 0xFF;
+  escPacket[19] = checksum >> 8;
+  escPacket[20] = 0xFF;
+  escPacket[21] = 0xFF;
+}
+
+void runBenchmarks(Print* out) {
+#ifndef SIL_PIO
+  setupCycleCounter();
+  // Wait a while for a serial monitor, the results are printed once
+  while (!Serial && millis() < 10000) resetWatchdog();
+#endif
+  makeEscPacket();
+  refreshDeviceData(&deviceData);
+  for (int i = 0; i < 8; i++) throttlePotBuffer.push(1000 + 300 * i);
+
+  // Cost of the timing itself, subtracted from every sample
+  const uint32_t overhead = measure(benchEmpty, BENCH_RUNS, 0);
+
+  out->println("bench,version,platform,function,unit,runs,min,median,max");
+  runBenchmark(out, "checkFletcher16", benchFletcher16, BENCH_RUNS, overhead);
+  runBenchmark(out, "parseEscSerialData", benchParseEsc, BENCH_RUNS, overhead);
+  runBenchmark(out, "crc16", benchCrc16, BENCH_RUNS, overhead);
+  runBenchmark(out, "getBatteryPercent", benchBatteryPercent, BENCH_RUNS, overhead);
+  runBenchmark(out, "updateFlightTime", benchFlightTime, BENCH_RUNS, overhead);
+  runBenchmark(out, "addHistorySample", benchHistorySample, BENCH_RUNS, overhead);
+  runBenchmark(out, "getAvgPot+map", benchThrottleMap, BENCH_RUNS, overhead);
+  runBenchmark(out, "limitThrottle", benchLimitThrottle, BENCH_RUNS, overhead);
+  runBenchmark(out, "updateDisplay", benchUpdateDisplay, BENCH_DISPLAY_RUNS, overhead);
+
+  throttlePotBuffer.clear();
+  resetEscTelemetry();
+  resetHistory();
+  resetFlightTimeWindow();
+  resetThrottleLimit();
+}
+
+#endif  // BENCHMARK
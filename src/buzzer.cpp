@@ -7,40 +7,154 @@
 
 #include <Arduino.h>
 
+#define NOTE_DURATION       125  // ms, an eighth note
+#define BUZZER_QUEUE_SIZE   32   // notes, power of 2
+
+// Notes waiting to be played. Single producer (buzzerNote on the main loop),
+// single consumer (the timer interrupt on the M0, core1 on the RP2040), so
+// each side only writes its own index.
+static STR_NOTE noteQueue[BUZZER_QUEUE_SIZE];
+static volatile uint8_t noteHead = 0;
+static volatile uint8_t noteTail = 0;
+
+bool popBuzzerNote(STR_NOTE* note) {
+  if (noteTail == noteHead) return false;
+  *note = noteQueue[noteTail % BUZZER_QUEUE_SIZE];
+  __sync_synchronize();  // Read the note before freeing its slot
+  noteTail = noteTail + 1;
+  return true;
+}
+
+#ifdef M0_PIO
+// TC3 (tone() uses TC5, Servo uses TC4) interrupts at twice the note
+// frequency to toggle the buzzer pin, and counts down the note duration.
+// Rests tick at 1 kHz without toggling.
+#define BUZZER_TIMER_HZ  (F_CPU / 16)
+#define REST_TICK_HZ     1000
+
+static volatile bool playing = false;
+static volatile bool toggling = false;
+static volatile uint32_t ticksLeft = 0;
+static volatile uint32_t* pinToggleReg;
+static volatile uint32_t* pinClearReg;
+static uint32_t pinMask;
+
+static void syncBuzzerTimer() {
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY) {}
+}
+
+// Start the next queued note, or stop the timer. Runs in the interrupt, or
+// with the interrupt disabled.
+static void startNextNote() {
+  *pinClearReg = pinMask;
+  STR_NOTE note;
+  if (!popBuzzerNote(&note)) {
+    TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    syncBuzzerTimer();
+    playing = false;
+    return;
+  }
+  const uint32_t tickHz = note.f.freq != 0 ? 2 * note.f.freq : REST_TICK_HZ;
+  toggling = note.f.freq != 0;
+  ticksLeft = max(tickHz * note.f.duration / 1000, static_cast<uint32_t>(1));
+  TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+  syncBuzzerTimer();
+  TC3->COUNT16.COUNT.reg = 0;
+  syncBuzzerTimer();
+  TC3->COUNT16.CC[0].reg = min(BUZZER_TIMER_HZ / tickHz, static_cast<uint32_t>(0x10000)) - 1;
+  syncBuzzerTimer();
+  TC3->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+  syncBuzzerTimer();
+  playing = true;
+}
+
+void TC3_Handler() {
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  if (toggling) *pinToggleReg = pinMask;
+  if (--ticksLeft == 0) startNextNote();
+}
+
+static void setupBuzzerTimer() {
+  const PinDescription& pin = g_APinDescription[BUZZER_PIN];
+  pinToggleReg = &PORT->Group[pin.ulPort].OUTTGL.reg;
+  pinClearReg = &PORT->Group[pin.ulPort].OUTCLR.reg;
+  pinMask = 1ul << pin.ulPin;
+
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+  while (GCLK->STATUS.bit.SYNCBUSY) {}
+  TC3->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+  syncBuzzerTimer();
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV16;
+  syncBuzzerTimer();
+  TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+  NVIC_SetPriority(TC3_IRQn, 3);  // Lowest, the ESC UART and servo come first
+  NVIC_EnableIRQ(TC3_IRQn);
+}
+#endif  // M0_PIO
+
 void buzzerNote(uint16_t freq, uint16_t millis) {
-#ifdef RP_PIO
-  // Non-blocking tone function that uses the rp2040's second core
+  if (static_cast<uint8_t>(noteHead - noteTail) >= BUZZER_QUEUE_SIZE) return;  // Full, drop the note
   STR_NOTE note;
   note.f.freq = freq;
   note.f.duration = millis;
-  rp2040.fifo.push_nb(note.data);
-#else
-  // Blocking buzzer may cause timing issues in the main control loops.
-  // TODO(thandal): implement non-blocking buzzer (or use a library like ezBuzzer)
-  // Blocking tone function that delays for notes
-  tone(BUZZER_PIN, freq);
-  delay(millis);  // to distinguish the notes, delay between them
-  noTone(BUZZER_PIN);
+  noteQueue[noteHead % BUZZER_QUEUE_SIZE] = note;
+  __sync_synchronize();  // Store the note before publishing it
+  noteHead = noteHead + 1;
+#ifdef M0_PIO
+  // Kick the timer if it's idle. The interrupt keeps it going from there.
+  NVIC_DisableIRQ(TC3_IRQn);
+  if (!playing) startNextNote();
+  NVIC_EnableIRQ(TC3_IRQn);
 #endif
 }
 
 void buzzerSequence(uint16_t sequence[], int len) {
   if (!ENABLE_BUZ) return;
   for (int thisNote = 0; thisNote < len; thisNote++) {
-    // quarter note = 1000 / 4, eigth note = 1000/8, etc.
-    int noteDuration = 125;
-    buzzerNote(sequence[thisNote], noteDuration);
+    buzzerNote(sequence[thisNote], NOTE_DURATION);
   }
 }
 
 void buzzerSequence(uint16_t freq1, uint16_t freq2, uint16_t freq3) {
   if (!ENABLE_BUZ) return;
-  const int noteDuration = 125;
-  buzzerNote(freq1, noteDuration);
-  if (freq2 != 0) buzzerNote(freq2, noteDuration);
-  if (freq3 != 0) buzzerNote(freq3, noteDuration);
+  buzzerNote(freq1, NOTE_DURATION);
+  if (freq2 != 0) buzzerNote(freq2, NOTE_DURATION);
+  if (freq3 != 0) buzzerNote(freq3, NOTE_DURATION);
+}
+
+void buzzerMelody(const STR_NOTE melody[], int len) {
+  if (!ENABLE_BUZ) return;
+  for (int i = 0; i < len; i++) {
+    buzzerNote(melody[i].f.freq, melody[i].f.duration);
+  }
 }
 
+#ifdef RP_PIO
+static bool notePlaying = false;
+static uint32_t noteStartMillis = 0;
+static uint16_t noteMillis = 0;
+
+// Called from loop1 on core1. Doesn't wait for a note to end, so the I2C
+// jobs on the same core keep running. A job can make a note up to 20 ms long.
+bool playBuzzerNotes() {
+  if (notePlaying) {
+    if (millis() - noteStartMillis < noteMillis) return false;
+    noTone(BUZZER_PIN);
+    notePlaying = false;
+  }
+  STR_NOTE note;
+  if (!popBuzzerNote(&note)) return false;
+  if (note.f.freq != 0) tone(BUZZER_PIN, note.f.freq);
+  noteStartMillis = millis();
+  noteMillis = note.f.duration;
+  notePlaying = true;
+  return true;
+}
+#endif
+
 void setupBuzzer() {
   pinMode(BUZZER_PIN, OUTPUT);  // Set up the buzzer
+#ifdef M0_PIO
+  setupBuzzerTimer();
+#endif
 }
@@ -0,0 +1,45 @@
+#include "sp140/clock.h"
+
+#include "sp140/config.h"
+
+#include <Arduino.h>
+
+#ifdef RP_PIO
+  #include "hardware/clocks.h"
+
+  #define PERI_HZ  48000000  // USB PLL
+#endif
+
+static const uint32_t kProfileKhz[] = {CLOCK_IDLE_KHZ, CLOCK_ARMED_KHZ};
+static uint32_t cpuKhz = CLOCK_ARMED_KHZ;  // The build's F_CPU
+
+#ifdef RP_PIO
+static void usePeripheralPll() {
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, PERI_HZ, PERI_HZ);
+}
+#endif
+
+void setupClock() {
+#ifdef RP_PIO
+  usePeripheralPll();
+#endif
+}
+
+bool setClockProfile(uint8_t profile) {
+  const uint32_t khz = kProfileKhz[profile];
+  if (khz == cpuKhz) return false;
+#ifdef RP_PIO
+  if (khz == PERI_HZ / 1000) {
+    set_sys_clock_48mhz();  // Runs from the USB PLL and stops the system PLL
+  } else if (!set_sys_clock_khz(khz, false)) {
+    return false;
+  }
+  usePeripheralPll();  // Changing the system clock moves it back to clk_sys
+#endif
+  cpuKhz = khz;
+  return true;
+}
+
+uint32_t getCpuKhz() {
+  return cpuKhz;
+}
@@ -0,0 +1,36 @@
+#include "sp140/cobs.h"
+
+uint16_t cobsEncode(const uint8_t* in, uint16_t len, uint8_t* out) {
+  uint16_t codePos = 0;  // where the length of the current block goes
+  uint16_t pos = 1;
+  uint8_t code = 1;
+  for (uint16_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[pos++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[codePos] = code;
+      codePos = pos++;
+      code = 1;
+    }
+  }
+  out[codePos] = code;
+  return pos;
+}
+
+uint16_t cobsDecode(const uint8_t* in, uint16_t len, uint8_t* out) {
+  uint16_t pos = 0;
+  uint16_t n = 0;
+  while (pos < len) {
+    const uint8_t code = in[pos++];
+    if (code == 0 || pos + code - 1 > len) return 0;
+    for (uint8_t i = 1; i < code; i++) {
+      if (in[pos] == 0) return 0;
+      out[n++] = in[pos++];
+    }
+    // A block shorter than 254 bytes ends with a zero, except the last one
+    if (code != 0xFF && pos < len) out[n++] = 0;
+  }
+  return n;
+}
@@ -1,22 +1,24 @@
 #include "sp140/config.h"
 #include "sp140/device_data.h"
+#include "sp140/journal.h"
 #include "sp140/structs.h"
 
-// Hardware-specific libraries
-#ifdef M0_PIO
-  #include <extEEPROM.h>  // https://github.com/PaoloP74/extEEPROM
-#elif RP_PIO
-  #include <EEPROM.h>
-#endif
+#include <Arduino.h>
 
-# define EEPROM_OFFSET 0  // Address of first byte of EEPROM
+// The journal stores everything except the trailing crc, which it replaces
+// with its own per-record crc.
+#define DEVICE_DATA_IMAGE_SIZE (sizeof(STR_DEVICE_DATA_140_V1) - 2)
 
-#ifdef M0_PIO
-  extEEPROM eep(kbits_64, 1, 64);
-#endif
+// Wait for this long without new writes before committing, to coalesce bursts
+#define DEVICE_DATA_COMMIT_DELAY  500  // ms
+
+static STR_DEVICE_DATA_140_V1 pendingDeviceData;
+static bool pendingDirty = false;
+static uint32_t pendingSinceMillis = 0;
+static STR_PERSIST_STATS persistStats;
 
 // For CRC: Xmodem lookup table 0x1021 poly
-static const uint16_t crc16table[] ={
+static const uint16_t SCRATCH_DATA("crc16table") crc16table[] ={
     0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7, 0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
     0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6, 0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
     0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485, 0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
@@ -35,7 +37,7 @@ static const uint16_t crc16table[] ={
     0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8, 0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
-uint16_t crc16(const uint8_t* buf, uint32_t size) {
+uint16_t RAM_FUNC(crc16)(const uint8_t* buf, uint32_t size) {
   uint16_t crc = 0;
   for (uint32_t i = 0; i < size; i++)
     crc = (crc << 8) ^ crc16table[buf[i] ^ (crc >> 8)];
@@ -43,11 +45,51 @@ uint16_t crc16(const uint8_t* buf, uint32_t size) {
 }
 
 void setupDeviceData() {
-  #ifdef M0_PIO
-    eep.begin(eep.twiClock100kHz);
-  #elif RP_PIO
-    EEPROM.begin(512);
-  #endif
+  setupJournal();
+  STR_DEVICE_DATA_140_V1 deviceData;
+  if (journalMount(reinterpret_cast<uint8_t*>(&deviceData), DEVICE_DATA_IMAGE_SIZE)) return;
+
+  // Empty journal: migrate the record written by older firmware, if valid.
+  journalReadLegacy(reinterpret_cast<uint8_t*>(&deviceData), sizeof(deviceData));
+  const uint16_t crc = crc16(reinterpret_cast<uint8_t*>(&deviceData), sizeof(deviceData) - 2);
+  if (crc == deviceData.crc) {
+    journalWrite(reinterpret_cast<uint8_t*>(&deviceData), DEVICE_DATA_IMAGE_SIZE);
+  }
+}
+
+static void recordCommit(bool ok, uint32_t startMicros) {
+  const uint32_t elapsed = micros() - startMicros;
+  persistStats.commits++;
+  if (!ok) persistStats.failures++;
+  persistStats.lastMicros = elapsed;
+  if (elapsed > persistStats.maxMicros) persistStats.maxMicros = elapsed;
+}
+
+// Do at most one storage operation per call, so each stall stays short.
+void serviceDeviceData() {
+  const uint32_t startMicros = micros();
+  if (pendingDirty && millis() - pendingSinceMillis >= DEVICE_DATA_COMMIT_DELAY) {
+    flushDeviceData();
+  } else if (journalNeedsCompaction()) {
+    recordCommit(journalCompact(), startMicros);
+  }
+}
+
+void flushDeviceData() {
+  if (!pendingDirty) return;
+  const uint32_t startMicros = micros();
+  const bool ok = journalWrite(reinterpret_cast<uint8_t*>(&pendingDeviceData), DEVICE_DATA_IMAGE_SIZE);
+  recordCommit(ok, startMicros);
+  // On failure keep the data pending and retry on the next service call.
+  if (ok) {
+    pendingDirty = false;
+  } else {
+    pendingSinceMillis = millis();
+  }
+}
+
+const STR_PERSIST_STATS& getPersistStats() {
+  return persistStats;
 }
 
 //  // For debugging
@@ -73,19 +115,17 @@ void sanitizeDeviceData(STR_DEVICE_DATA_140_V1* deviceData) {
     deviceData->batt_size = 4000;
 }
 
-// Write deviceData to EEPROM
+// Queue deviceData to be committed to the journal by serviceDeviceData()
 void writeDeviceData(STR_DEVICE_DATA_140_V1* deviceData) {
   sanitizeDeviceData(deviceData);
   deviceData->crc = crc16(reinterpret_cast<uint8_t*>(deviceData), sizeof(*deviceData) - 2);
-  #ifdef M0_PIO
-    eep.write(EEPROM_OFFSET, reinterpret_cast<uint8_t*>(deviceData), sizeof(*deviceData));
-  #elif RP_PIO
-    EEPROM.put(EEPROM_OFFSET, *deviceData);
-    EEPROM.commit();
-  #endif
+  if (pendingDirty) persistStats.coalesced++;
+  pendingDeviceData = *deviceData;
+  pendingDirty = true;
+  pendingSinceMillis = millis();
 }
 
-// Reset deviceData to factory defaults and write to EEPROM
+// Reset deviceData to factory defaults and queue it for writing
 void resetDeviceData(STR_DEVICE_DATA_140_V1* deviceData) {
   deviceData->version_major = VERSION_MAJOR;
   deviceData->version_minor = VERSION_MINOR;
@@ -102,17 +142,17 @@ void resetDeviceData(STR_DEVICE_DATA_140_V1* deviceData) {
   writeDeviceData(deviceData);
 }
 
-// Read saved data from EEPROM
+// Read the latest saved (or queued) data
 void refreshDeviceData(STR_DEVICE_DATA_140_V1* deviceData) {
-  #ifdef M0_PIO
-    eep.read(EEPROM_OFFSET, reinterpret_cast<uint8_t*>(deviceData), sizeof(*deviceData));
-  #elif RP_PIO
-    EEPROM.get(EEPROM_OFFSET, *deviceData);
-  #endif
-  // Reset the data if there is a checksum error.
+  if (pendingDirty) {
+    *deviceData = pendingDeviceData;
+    return;
+  }
+  // Reset the data if the journal holds no valid record.
   // TODO(thandal): provide some sort of error?
-  uint16_t crc = crc16(reinterpret_cast<uint8_t*>(deviceData), sizeof(*deviceData) - 2);
-  if (crc != deviceData->crc) {
+  if (!journalRead(reinterpret_cast<uint8_t*>(deviceData), DEVICE_DATA_IMAGE_SIZE)) {
     resetDeviceData(deviceData);
+    return;
   }
+  deviceData->crc = crc16(reinterpret_cast<uint8_t*>(deviceData), sizeof(*deviceData) - 2);
 }
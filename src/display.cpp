@@ -1,7 +1,11 @@
 #include "sp140/display.h"
 
+#include "sp140/battery.h"
 #include "sp140/config.h"
+#include "sp140/esc_telemetry.h"
+#include "sp140/history.h"
 #include "sp140/openppg_logo.h"
+#include "sp140/throttle_limit.h"
 #include "sp140/structs.h"
 
 // DEBUG WATCHDOG
@@ -14,36 +18,45 @@
 Adafruit_ST7735 display = Adafruit_ST7735(TFT_CS, TFT_DC, TFT_RST);
 GFXcanvas16 canvas(160, 128);
 
-double mapd(double x, double in_min, double in_max, double out_min, double out_max) {
-  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+// Print a fixed-point value with one decimal, like printf("%*.1f")
+static void printTenths(int32_t tenths, int width) {
+  char text[16];
+  const uint32_t magnitude = tenths < 0 ? -tenths : tenths;
+  snprintf(text, sizeof(text), "%s%u.%u", tenths < 0 ? "-" : "",
+           static_cast<unsigned int>(magnitude / 10), static_cast<unsigned int>(magnitude % 10));
+  canvas.printf("%*s", width, text);
 }
 
-// Map voltage to battery percentage, based on a
-// simple set of data points from load testing.
-float getBatteryPercent(float voltage) {
-  float battPercent = 0;
-  if (voltage > 94.8) {
-    battPercent = mapd(voltage, 94.8, 99.6, 90, 100);
-  } else if (voltage > 93.36) {
-    battPercent = mapd(voltage, 93.36, 94.8, 80, 90);
-  } else if (voltage > 91.68) {
-    battPercent = mapd(voltage, 91.68, 93.36, 70, 80);
-  } else if (voltage > 89.76) {
-    battPercent = mapd(voltage, 89.76, 91.68, 60, 70);
-  } else if (voltage > 87.6) {
-    battPercent = mapd(voltage, 87.6, 89.76, 50, 60);
-  } else if (voltage > 85.2) {
-    battPercent = mapd(voltage, 85.2, 87.6, 40, 50);
-  } else if (voltage > 82.32) {
-    battPercent = mapd(voltage, 82.32, 85.2, 30, 40);
-  } else if (voltage > 80.16) {
-    battPercent = mapd(voltage, 80.16, 82.32, 20, 30);
-  } else if (voltage > 78) {
-    battPercent = mapd(voltage, 78, 80.16, 10, 20);
-  } else if (voltage > 60.96) {
-    battPercent = mapd(voltage, 60.96, 78, 0, 10);
+// Round a fixed-point value to a coarser unit, halves away from zero
+static int32_t roundDiv(int32_t value, int32_t divisor) {
+  return (value >= 0 ? value + divisor / 2 : value - divisor / 2) / divisor;
+}
+
+// Draw a history series as min/max bars, oldest on the left, scaled to its
+// own range. Uses the finest history level that covers the whole flight.
+static void drawSparkline(uint8_t series, int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  const uint8_t level = getHistoryLevel();
+  const uint8_t count = getHistoryCount(level);
+  if (count < 2) return;
+  int16_t low = INT16_MAX;
+  int16_t high = INT16_MIN;
+  for (uint8_t age = 0; age < count; age++) {
+    const STR_HISTORY_BUCKET& bucket = getHistoryBucket(series, level, age);
+    if (bucket.min > bucket.max) continue;  // No samples
+    if (bucket.min < low) low = bucket.min;
+    if (bucket.max > high) high = bucket.max;
+  }
+  if (low > high) return;
+  const int32_t range = max(high - low, 1);
+  for (uint8_t age = 0; age < count; age++) {
+    const STR_HISTORY_BUCKET& bucket = getHistoryBucket(series, level, age);
+    if (bucket.min > bucket.max) continue;
+    const int16_t left = x + w - (age + 1) * w / count;
+    const int16_t right = x + w - age * w / count;
+    const int16_t top = y + h - 1 - (bucket.max - low) * (h - 1) / range;
+    const int16_t bottom = y + h - 1 - (bucket.min - low) * (h - 1) / range;
+    canvas.fillRect(left, top, right - left, bottom - top + 1, color);
   }
-  return constrain(battPercent, 0, 100);
 }
 
 // Clears screen and resets properties
@@ -97,6 +110,9 @@ void updateDisplay(
 
   const unsigned int nowMillis = millis();
 
+  // Power over the flight, behind the power and energy values
+  drawSparkline(HISTORY_POWER, 0, 37, 160, 43, GRAY);
+
   // Display region lines
   canvas.drawFastHLine(0, 36, 160, BLACK);
   canvas.drawFastVLine(100, 0, 36, BLACK);
@@ -105,24 +121,28 @@ void updateDisplay(
 
   // Display battery level and status
   canvas.setTextSize(2);
-  const float batteryPercent = getBatteryPercent(escTelemetry.volts);
+  const uint8_t batteryPercent = getBatteryPercent(escTelemetry.centiVolts);
   //   Display battery bar
-  if ((nowMillis - escTelemetry.lastUpdateMillis) > 2000) {
+  const int8_t staleEsc = getStaleEsc(nowMillis);
+  if (staleEsc >= 0) {
     canvas.setCursor(4, 3);
     canvas.setTextColor(RED);
-    canvas.print("ESC DATA\n  ERROR");
+    if (ESC_COUNT > 1) {
+      canvas.printf("ESC DATA\n ERROR %d", staleEsc + 1);
+    } else {
+      canvas.print("ESC DATA\n  ERROR");
+    }
   } else {
     if (batteryPercent > 0) {
       unsigned int batteryColor = RED;
       if (batteryPercent >= 30) batteryColor = GREEN;
       else if (batteryPercent >= 15) batteryColor = YELLOW;
-      int batteryPercentWidth = map(static_cast<int>(batteryPercent), 0, 100, 0, 100);
-      canvas.fillRect(0, 0, batteryPercentWidth, 36, batteryColor);
+      canvas.fillRect(0, 0, batteryPercent, 36, batteryColor);
     } else {
       canvas.setCursor(12, 3);
       canvas.setTextColor(RED);
       canvas.println("BATTERY");
-      if (escTelemetry.volts < 10) {
+      if (escTelemetry.centiVolts < 1000) {
         canvas.print(" ERROR");
       } else {
         canvas.print(" DEAD");
@@ -132,22 +152,37 @@ void updateDisplay(
   //   Display battery percent
   canvas.setCursor(108, 10);
   canvas.setTextColor(BLACK);
-  canvas.printf("%3d%%", static_cast<int>(batteryPercent));
+  canvas.printf("%3d%%", batteryPercent);
 
-  const float kWatts = constrain(escTelemetry.watts / 1000.0, 0, 50);
-  const float volts = escTelemetry.volts;
-  const float kWh = escTelemetry.wattHours / 1000.0;
-  const float amps = escTelemetry.amps;
+  // Flight time left at the recent average power
+  const STR_FLIGHT_TIME_ESTIMATE& flightTime = getFlightTimeEstimate();
+  canvas.setTextSize(1);
+  canvas.setCursor(112, 1);
+  if (flightTime.minutes == FLIGHT_TIME_UNKNOWN) {
+    canvas.print("  -min");
+  } else {
+    canvas.printf("%3dmin", flightTime.minutes);
+  }
+  canvas.setTextSize(2);
 
   canvas.setCursor(1, 42);
-  canvas.printf("%4.1fkW  %4.1fV", kWatts, volts);
+  printTenths(roundDiv(constrain(escTelemetry.watts, 0, 50000), 100), 4);
+  canvas.print("kW  ");
+  printTenths(roundDiv(escTelemetry.centiVolts, 10), 4);
+  canvas.print("V");
   canvas.setCursor(1, 61);
-  canvas.printf("%4.1fkWh %4.1fA", kWh, amps);
+  printTenths(roundDiv(escTelemetry.milliwattHours, 100000), 4);
+  canvas.print("kWh ");
+  printTenths(roundDiv(escTelemetry.centiAmps, 10), 4);
+  canvas.print("A");
 
   // Display modes
   canvas.setCursor(8, 83);
   canvas.setTextSize(1);
-  if (deviceData.performance_mode == 0) {
+  if (getThrottleLimit().active) {
+    canvas.setTextColor(BLACK, ORANGE);
+    canvas.print("LIMIT");
+  } else if (deviceData.performance_mode == 0) {
       canvas.setTextColor(BLUE);
       canvas.print("CHILL");
   } else {
@@ -179,6 +214,7 @@ void updateDisplay(
   if (cruising) statusBarColor = YELLOW;
   else if (armed) statusBarColor = CYAN;
   canvas.fillRect(0, 93, 160, 40, statusBarColor);
+  drawSparkline(HISTORY_ALTITUDE, 0, 93, 160, 35, GRAY);
 
   // Display armed time for the current session
   canvas.setTextColor(BLACK);
@@ -207,7 +243,8 @@ void updateDisplay(
   // ESC temperature
   canvas.setTextSize(1);
   canvas.setCursor(114, 28);
-  canvas.printf("%0.1f%cC", escTelemetry.temperatureC, 247);  // Note: 247 is the 'degree' character.
+  printTenths(escTelemetry.deciCelsius, 0);
+  canvas.printf("%cC", 247);  // Note: 247 is the 'degree' character.
 
 //  // DEBUG TIMING
 //  canvas.setTextSize(1);
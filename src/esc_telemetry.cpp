@@ -33,18 +33,64 @@ typedef struct  {
 } STR_ESC_TELEMETRY_140_V2;
 #pragma pack(pop)
 
-static STR_ESC_TELEMETRY_140 escTelemetry;
-CircularBuffer<float, 50> voltsBuffer;
-uint32_t prevWattHoursMillis = 0;
+static_assert(sizeof(STR_ESC_TELEMETRY_140_V2) == ESC_PACKET_SIZE, "ESC packet size");
+
+typedef struct {
+  STR_ESC_TELEMETRY_140 telemetry;
+  CircularBuffer<uint16_t, 50> voltsBuffer;  // centivolts
+  uint32_t voltsSum;
+  uint32_t prevWattHoursMillis;
+  int64_t energy;  // centivolt * centiamp * ms, exact for any flight length
+  uint8_t packet[ESC_PACKET_SIZE];  // the packet being received
+  uint8_t packetLength;
+  bool synced;     // the last packet was valid
+} ESC_STATE;
+
+static HardwareSerial* const kEscSerials[] = ESC_SERIALS;
+static_assert(ESC_COUNT <= sizeof(kEscSerials) / sizeof(kEscSerials[0]), "ESC_SERIALS needs a UART per ESC");
+
+static ESC_STATE escs[ESC_COUNT];
+static STR_ESC_TELEMETRY_140 combinedTelemetry;  // All ESCs
+
+#define ENERGY_PER_MILLIWATT_HOUR  36000000  // 1 mWh = 3.6 J = 3.6e7 (0.0001 W * 1 ms)
+
+// Thermistor temperature (0.1 C) for raw readings 32, 64, ... 4064: a 10k NTC
+// (B 3455) in a divider with a 10k resistor on a 12-bit ADC. Interpolated
+// between points and rounded, this is within 0.14 C of the exact curve from
+// -40 C to 120 C.
+#define NTC_STEP  32
+static const int16_t kNtcDeciCelsius[] = {
+  2392, 1909, 1665, 1506, 1389, 1297, 1222, 1159, 1105, 1057, 1014, 976,
+  941, 909, 879, 852, 826, 802, 779, 758, 737, 718, 700, 682,
+  665, 649, 633, 618, 603, 589, 576, 562, 549, 537, 525, 513,
+  501, 490, 479, 468, 457, 447, 436, 426, 416, 407, 397, 387,
+  378, 369, 360, 351, 342, 333, 325, 316, 308, 299, 291, 283,
+  274, 266, 258, 250, 242, 234, 226, 218, 210, 202, 195, 187,
+  179, 171, 163, 155, 148, 140, 132, 124, 116, 108, 100, 92,
+  84, 76, 68, 60, 52, 44, 35, 27, 18, 9, 1, -8,
+  -17, -26, -36, -45, -55, -65, -75, -85, -95, -106, -117, -129,
+  -141, -153, -165, -179, -192, -207, -222, -238, -255, -274, -293, -315,
+  -339, -365, -396, -432, -476, -535, -629,
+};
+#define NTC_POINTS  (sizeof(kNtcDeciCelsius) / sizeof(kNtcDeciCelsius[0]))
+
+static int16_t RAM_FUNC(ntcDeciCelsius)(uint16_t raw) {
+  if (raw < NTC_STEP) raw = NTC_STEP;
+  if (raw > NTC_STEP * NTC_POINTS) raw = NTC_STEP * NTC_POINTS;
+  const uint16_t index = raw / NTC_STEP - 1;
+  if (index == NTC_POINTS - 1) return kNtcDeciCelsius[index];
+  const int32_t low = kNtcDeciCelsius[index];
+  const int32_t high = kNtcDeciCelsius[index + 1];
+  // The table falls, so the step is negative: subtract half to round to nearest
+  return low + ((high - low) * static_cast<int32_t>(raw % NTC_STEP) - NTC_STEP / 2) / NTC_STEP;
+}
 
 
 #define ESC_BAUD_RATE         115200
 // ESC packets (22 bytes) are transmitted about every 20 ms.
 // 22 bytes at 115200 bps should take about 2 ms.
-// We set the timeout to 2ms to be very conservative.
-#define ESC_TIMEOUT           2
 
-uint16_t checkFletcher16(byte buffer[], int len) {
+uint16_t RAM_FUNC(checkFletcher16)(byte buffer[], int len) {
   // See https://en.wikipedia.org/wiki/Fletcher's_checksum
   uint16_t c0 = 0;
   uint16_t c1 = 0;
@@ -56,11 +102,13 @@ uint16_t checkFletcher16(byte buffer[], int len) {
   return (c1 << 8) | c0;
 }
 
-void parseEscSerialData(byte buffer[]) {
+bool RAM_FUNC(parseEscSerialData)(uint8_t esc, byte buffer[]) {
+  ESC_STATE& state = escs[esc];
+  STR_ESC_TELEMETRY_140& escTelemetry = state.telemetry;
   if (buffer[20] != 255 || buffer[21] != 255) {
     escTelemetry.errorStopBytes++;
     // Serial.println("ESC parse error: no stop bytes");
-    return;
+    return false;
   }
 
   // Check the Fletcher checksum
@@ -72,45 +120,36 @@ void parseEscSerialData(byte buffer[]) {
   if (computedChecksum != checksum) {
     escTelemetry.errorChecksum++;
     // Serial.println("ESC parse error: bad checksum");
-    return;
+    return false;
   }
 
   STR_ESC_TELEMETRY_140_V2 &telem = *reinterpret_cast<STR_ESC_TELEMETRY_140_V2*>(buffer);
 
-  // Voltage
-  float volts = telem.rawVolts / 100.0;
-  const float kBattMinV = 60.0;   // 24 * 2.5V per cell
-  const float kVoltOffset = 1.5;  // Calibration
-  if (volts > kBattMinV) volts += kVoltOffset;
-
-  voltsBuffer.push(volts);
-  float avgVolts = 0.0;
-  for (decltype(voltsBuffer)::index_t i = 0; i < voltsBuffer.size(); ++i) {
-    avgVolts += voltsBuffer[i] / voltsBuffer.size();
-  }
-  escTelemetry.volts = avgVolts;
+  // Voltage (the ESC reports centivolts)
+  uint16_t centiVolts = telem.rawVolts;
+  const uint16_t kBattMinCentiV = 6000;  // 24 * 2.5V per cell
+  const uint16_t kCentiVoltOffset = 150;  // Calibration
+  if (centiVolts > kBattMinCentiV) centiVolts += kCentiVoltOffset;
 
-  // Current
-  escTelemetry.amps = telem.rawAmps / 12.5;
-  escTelemetry.watts = escTelemetry.amps * escTelemetry.volts;
+  // Running sum of the buffer, updated as samples come and go
+  if (state.voltsBuffer.isFull()) state.voltsSum -= state.voltsBuffer.first();
+  state.voltsBuffer.push(centiVolts);
+  state.voltsSum += centiVolts;
+  escTelemetry.centiVolts = (state.voltsSum + state.voltsBuffer.size() / 2) / state.voltsBuffer.size();
+
+  // Current (the ESC reports 1/12.5 A, 8 centiamps)
+  escTelemetry.centiAmps = telem.rawAmps * 8;
+  const int64_t power = static_cast<int64_t>(escTelemetry.centiVolts) * escTelemetry.centiAmps;  // 0.0001 W
+  escTelemetry.watts = power / 10000;
 
   // Energy
   const uint32_t currentMillis = millis();
-  const float deltaHours = (currentMillis - prevWattHoursMillis) / 1000.0 / 3600.0;
-  prevWattHoursMillis = currentMillis;
-  escTelemetry.wattHours += escTelemetry.watts * deltaHours;
+  state.energy += power * static_cast<int32_t>(currentMillis - state.prevWattHoursMillis);
+  state.prevWattHoursMillis = currentMillis;
+  escTelemetry.milliwattHours = state.energy / ENERGY_PER_MILLIWATT_HOUR;
 
   // Temperature
-  const float SERIESRESISTOR = 10000.0;
-  const float NOMINAL_RESISTANCE = 10000.0;
-  const float NOMINAL_TEMPERATURE = 25.0;
-  const float INV_T0 = 1.0 / (NOMINAL_TEMPERATURE + 273.15);
-  const float INV_B = 1.0 / 3455.0;
-  // Convert value to resistance
-  const float Rntc = SERIESRESISTOR / ((4096.0 / telem.rawTemperature) - 1);
-  // Compute the temperature
-  const float temperature = 1.0 / (log(Rntc / NOMINAL_RESISTANCE) * INV_B + INV_T0) - 273.15;
-  escTelemetry.temperatureC = temperature;
+  escTelemetry.deciCelsius = ntcDeciCelsius(telem.rawTemperature);
 
   // RPM
   const int POLECOUNT = 62;
@@ -127,40 +166,117 @@ void parseEscSerialData(byte buffer[]) {
 
   // Update freshness
   escTelemetry.lastUpdateMillis = millis();
+  return true;
+}
+
+// Add up the ESCs into the combined telemetry
+static void RAM_FUNC(combineEscTelemetry)(uint32_t nowMillis) {
+  STR_ESC_TELEMETRY_140 combined = {};
+  combined.deciCelsius = INT16_MIN;
+  uint32_t centiVolts = 0;
+  uint32_t rpm = 0;
+  uint32_t inPWM = 0;
+  uint32_t outPWM = 0;
+  uint8_t fresh = 0;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    const STR_ESC_TELEMETRY_140& esc = escs[i].telemetry;
+    combined.milliwattHours += esc.milliwattHours;
+    combined.lastReadBytes += esc.lastReadBytes;
+    combined.errorStopBytes += esc.errorStopBytes;
+    combined.errorChecksum += esc.errorChecksum;
+    if (esc.lastUpdateMillis == 0 || nowMillis - esc.lastUpdateMillis > ESC_STALE_MILLIS) continue;
+    fresh++;
+    centiVolts += esc.centiVolts;
+    combined.centiAmps += esc.centiAmps;
+    combined.watts += esc.watts;
+    combined.deciCelsius = max(combined.deciCelsius, esc.deciCelsius);
+    rpm += esc.rpm;
+    inPWM += esc.inPWM;
+    outPWM += esc.outPWM;
+    combined.statusFlag |= esc.statusFlag;
+  }
+  if (fresh > 0) {
+    combined.centiVolts = (centiVolts + fresh / 2) / fresh;
+    combined.rpm = rpm / fresh;
+    combined.inPWM = inPWM / fresh;
+    combined.outPWM = outPWM / fresh;
+  }
+  combined.lastUpdateMillis = nowMillis;
+  combinedTelemetry = combined;
 }
 
 const STR_ESC_TELEMETRY_140& getEscTelemetry() {
-  return escTelemetry;
+  return combinedTelemetry;
 }
 
-void updateEscTelemetry() {
-  // If this function is called slowly, readBytes sometimes includes *part* of the next packet.
-  // But on the next read, we get the start of a new packet, rather than the rest of the packet!?
-  // 1. Why doesn't the timeout cause readBytes to get the full next packet?
-  // 2. Why don't we see the rest of the packet on the *next* read?
-  // As a hack, we just try to parse from the front of the buffer... and it "works great"!
+const STR_ESC_TELEMETRY_140& getEscTelemetry(uint8_t esc) {
+  return escs[esc].telemetry;
+}
 
-  byte buffer[256];
-  escTelemetry.lastReadBytes = SerialESC.readBytes(buffer, sizeof(buffer));
+int8_t getStaleEsc(uint32_t nowMillis) {
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if (nowMillis - escs[i].telemetry.lastUpdateMillis > ESC_STALE_MILLIS) return i;
+  }
+  return -1;
+}
+
+// Read the bytes an ESC has sent and parse the packets among them. Out of
+// sync, the decoder slides along one byte at a time until a valid packet
+// ends with the stop bytes. Returns true if a packet was parsed.
+static bool RAM_FUNC(readEsc)(uint8_t esc) {
+  ESC_STATE& state = escs[esc];
+  HardwareSerial& serial = *kEscSerials[esc];
+  bool parsed = false;
+  uint32_t count = 0;
+  while (serial.available() > 0) {
+    state.packet[state.packetLength++] = serial.read();
+    count++;
+    if (state.packetLength < ESC_PACKET_SIZE) continue;
+
+    const bool stopBytes = state.packet[ESC_PACKET_SIZE - 2] == 255 && state.packet[ESC_PACKET_SIZE - 1] == 255;
+    if (stopBytes && parseEscSerialData(esc, state.packet)) {
+      state.packetLength = 0;
+      state.synced = true;
+      parsed = true;
+      continue;
+    }
+    if (state.synced && !stopBytes) state.telemetry.errorStopBytes++;  // Lost sync
+    state.synced = false;
+    memmove(state.packet, state.packet + 1, ESC_PACKET_SIZE - 1);
+    state.packetLength = ESC_PACKET_SIZE - 1;
+  }
+  state.telemetry.lastReadBytes = count;
 
 //  // DEBUG
-//  static unsigned int lastMillis = 0;
-//  unsigned int nowMillis = millis();
-//  Serial.printf("ESC DATA [%03d] (%03d): ", nowMillis - lastMillis, escTelemetry.lastReadBytes);
-//  lastMillis = nowMillis;
-//  for (int i = 0; i < escTelemetry.lastReadBytes; i++) {
-//    Serial.printf("%02X ", buffer[i]);
-//  }
-//  Serial.println();
-
-  if (escTelemetry.lastReadBytes >= 22) {
-    parseEscSerialData(buffer);
+//  if (count > 0) Serial.printf("ESC %d DATA [%03d] synced %d\n", esc, count, state.synced);
+
+  return parsed;
+}
+
+void RAM_FUNC(updateEscTelemetry)() {
+  bool parsed = false;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if (readEsc(i)) parsed = true;
   }
+  if (parsed) combineEscTelemetry(millis());
+}
+
+void resetEscTelemetry() {
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    ESC_STATE& state = escs[i];
+    state.telemetry = {};
+    state.voltsBuffer.clear();
+    state.voltsSum = 0;
+    state.prevWattHoursMillis = 0;
+    state.energy = 0;
+    state.packetLength = 0;
+    state.synced = false;
+  }
+  combinedTelemetry = {};
 }
 
 void setupEscTelemetry() {
-  SerialESC.begin(ESC_BAUD_RATE);
-  SerialESC.setTimeout(ESC_TIMEOUT);
-  escTelemetry.errorStopBytes = 0;
-  escTelemetry.errorChecksum = 0;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    kEscSerials[i]->begin(ESC_BAUD_RATE);
+  }
 }
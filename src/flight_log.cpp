@@ -0,0 +1,610 @@
+#include "sp140/flight_log.h"
+
+#include "sp140/config.h"
+#include "sp140/device_data.h"
+#include "sp140/journal.h"
+#include "sp140/log_codec.h"
+#include "sp140/structs.h"
+
+#include <Arduino.h>
+
+// Hardware-specific libraries
+#ifdef RP_PIO
+  #include <LittleFS.h>
+  #include <hardware/flash.h>
+#endif
+
+#define FLIGHT_LOG_DIR          "/flights"
+#define FLIGHT_CATALOG_PATH     "/catalog.bin"
+#ifdef RP_PIO
+  #define FLIGHT_LOG_BUFFER_SIZE  8192  // Power of 2. About 3.5 s of records at 50 Hz.
+#else
+  #define FLIGHT_LOG_BUFFER_SIZE  1     // No filesystem on the M0
+#endif
+#define FLIGHT_LOG_CHUNK_SIZE   256   // One flash page per write
+#define FLIGHT_LOG_COPY_CHUNKS  8     // Chunks copied from the stage to a file per call
+#define FLIGHT_LOG_MIN_FREE     (512 * 1024)  // Delete the oldest flights below this
+
+// Byte ring buffer between the telemetry thread and the flash writer.
+// logHead and logTail run freely, their difference is the fill level.
+static uint8_t logBuffer[FLIGHT_LOG_BUFFER_SIZE];
+static uint32_t logHead = 0;
+static uint32_t logTail = 0;
+static uint32_t logEnd = 0;  // Where the closing flight ends in the buffer
+
+static bool fsReady = false;
+static bool flying = false;   // Between startFlightLog() and stopFlightLog()
+static bool logging = false;  // Accepting records
+static bool closing = false;  // Finish the flight once the buffer has drained up to logEnd
+static uint32_t oldestFlightNumber = 0;  // 0 = none on the filesystem
+static uint32_t newestFlightNumber = 0;
+static uint32_t nextRecordMillis = 0;
+static uint32_t nextFlightNumber = 1;
+static STR_FLIGHT_LOG_STATS flightLogStats;
+static STR_LOG_CODEC_STATE codecState;
+
+#ifdef RP_PIO
+// Running totals of a flight, in telemetry units
+typedef struct {
+  int32_t startMilliwattHours;
+  int32_t lastMilliwattHours;
+  int32_t peakWatts;
+  int16_t maxDeciCelsius;
+} STR_FLIGHT_TOTALS;
+
+// Update a catalog entry with the next record of its flight. The running
+// totals stay fixed-point, the entry keeps floats (its stored format).
+static void summarizeRecord(STR_FLIGHT_CATALOG_ENTRY* entry, STR_FLIGHT_TOTALS* totals,
+                            const STR_FLIGHT_RECORD_140& record) {
+  if (entry->records == 0) {
+    totals->startMilliwattHours = record.milliwattHours;
+    totals->peakWatts = record.watts;
+    totals->maxDeciCelsius = record.deciCelsius;
+  }
+  entry->records++;
+  entry->durationMillis = record.millis - entry->startMillis;
+  totals->lastMilliwattHours = record.milliwattHours;
+  if (record.watts > totals->peakWatts) totals->peakWatts = record.watts;
+  if (record.deciCelsius > totals->maxDeciCelsius) totals->maxDeciCelsius = record.deciCelsius;
+}
+
+static File readFile;  // Kept open between reads of the same file
+static uint32_t readFlightNumber = 0;
+
+// Fill in the totals before the entry is stored
+static void finishSummary(STR_FLIGHT_CATALOG_ENTRY* entry, const STR_FLIGHT_TOTALS& totals) {
+  entry->wattHours = (totals.lastMilliwattHours - totals.startMilliwattHours) / 1000.0f;
+  entry->peakWatts = totals.peakWatts;
+  entry->maxTemperatureC = totals.maxDeciCelsius / 10.0f;
+}
+
+static void flightPath(uint32_t flightNumber, char* path, size_t size) {
+  snprintf(path, size, FLIGHT_LOG_DIR "/%05u.bin", static_cast<unsigned int>(flightNumber));
+}
+
+// Find the lowest and highest flight numbers on the filesystem
+static bool findFlights(uint32_t* oldest, uint32_t* newest) {
+  bool found = false;
+  Dir dir = LittleFS.openDir(FLIGHT_LOG_DIR);
+  while (dir.next()) {
+    const uint32_t flightNumber = atoi(dir.fileName().c_str());
+    if (flightNumber == 0) continue;
+    if (!found || flightNumber < *oldest) *oldest = flightNumber;
+    if (!found || flightNumber > *newest) *newest = flightNumber;
+    found = true;
+  }
+  return found;
+}
+
+// Delete the oldest flights until there is room for a new one of this size
+static void makeRoom(uint32_t bytes) {
+  FSInfo info;
+  uint32_t oldest, newest;
+  while (LittleFS.info(info) && info.totalBytes - info.usedBytes < FLIGHT_LOG_MIN_FREE + bytes &&
+         findFlights(&oldest, &newest)) {
+    char path[32];
+    flightPath(oldest, path, sizeof(path));
+    if (readFile && readFlightNumber == oldest) readFile.close();
+    if (!LittleFS.remove(path)) break;
+  }
+  oldestFlightNumber = findFlights(&oldest, &newest) ? oldest : 0;
+  newestFlightNumber = oldestFlightNumber ? newest : 0;
+}
+
+static void writeCatalogEntry(STR_FLIGHT_CATALOG_ENTRY* entry) {
+  entry->crc = crc16(reinterpret_cast<uint8_t*>(entry), sizeof(*entry) - 2);
+  if (!LittleFS.exists(FLIGHT_CATALOG_PATH)) LittleFS.open(FLIGHT_CATALOG_PATH, "w").close();
+  File catalog = LittleFS.open(FLIGHT_CATALOG_PATH, "r+");
+  if (!catalog) return;
+  // Seeking past the end is fine, the gap reads back as empty entries.
+  if (readFile && readFlightNumber == 0) readFile.close();
+  if (catalog.seek((entry->flightNumber - 1) * sizeof(*entry))) {
+    catalog.write(reinterpret_cast<uint8_t*>(entry), sizeof(*entry));
+  }
+  catalog.close();
+}
+
+// Summarize a flight file that was never closed (e.g. power off while armed)
+static void rebuildCatalogEntry(uint32_t flightNumber) {
+  char path[32];
+  flightPath(flightNumber, path, sizeof(path));
+  File file = LittleFS.open(path, "r");
+  if (!file) return;
+  STR_FLIGHT_LOG_HEADER header;
+  if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+      header.magic != FLIGHT_LOG_MAGIC || header.version != FLIGHT_LOG_VERSION) {
+    file.close();
+    return;
+  }
+
+  STR_FLIGHT_CATALOG_ENTRY entry = {};
+  entry.flightNumber = flightNumber;
+  entry.startMillis = header.startMillis;
+  entry.dataOffset = sizeof(header);
+  entry.dataBytes = file.size() - sizeof(header);
+  STR_FLIGHT_TOTALS totals = {};
+
+  STR_LOG_CODEC_STATE state;
+  resetLogCodec(&state);
+  uint8_t buf[256];
+  uint32_t have = 0;
+  while (true) {
+    const size_t n = file.read(buf + have, sizeof(buf) - have);
+    have += n;
+    uint32_t pos = 0;
+    uint8_t used;
+    STR_FLIGHT_RECORD_140 record;
+    while ((used = decodeFlightRecord(&state, buf + pos, have - pos, &record)) > 0) {
+      summarizeRecord(&entry, &totals, record);
+      pos += used;
+    }
+    memmove(buf, buf + pos, have - pos);
+    have -= pos;
+    if (n == 0) break;  // End of file, or a frame that can't be decoded
+  }
+  file.close();
+  finishSummary(&entry, totals);
+  writeCatalogEntry(&entry);
+}
+
+//
+// Staging area. Erasing a flash sector stalls both cores for tens of ms, and
+// the filesystem erases whenever a file grows into a new block. So flights are
+// recorded into raw flash that was erased ahead of time while disarmed, and
+// flying only programs pages (well under a millisecond each). Once disarmed,
+// staged flights are copied into their files.
+//
+// The stage is the free program flash between the firmware image and the
+// journal, used as a ring. Each flight starts on a sector boundary with its
+// header, and loses the header sector once it has been copied, so after a
+// reset the flights still to copy are the sectors starting with a header.
+// Writing stops a sector short of unerased flash, so an erased page always
+// follows the newest flight: a flight ends at the first erased page or the
+// next header. Records never end in 0xFF, so the erased tail of the last page
+// is trimmed off.
+//
+
+#define FLIGHT_STAGE_GUARD    FLASH_SECTOR_SIZE       // Kept erased after the newest flight
+#define FLIGHT_STAGE_RESERVE  (16 * FLASH_SECTOR_SIZE)  // Erase this much before copying
+#define FLIGHT_STAGE_MIN_SIZE (64 * FLASH_SECTOR_SIZE)
+
+extern uint8_t __flash_binary_end;
+
+static uint32_t stageStart = 0;   // Flash offset
+static uint32_t stageSize = 0;    // 0 = the firmware leaves no room for it
+static uint32_t stageCopy = 0;    // Where the oldest flight not yet copied starts
+static uint32_t stageUsed = 0;    // Bytes of flights from stageCopy on
+static uint32_t stageErased = 0;  // Erased bytes after those
+
+static File copyFile;
+static uint32_t copyFlightNumber = 0;  // 0 = not copying
+static uint32_t copyLength = 0;
+static uint32_t copyPos = 0;
+static uint32_t decodePos = 0;
+static STR_LOG_CODEC_STATE copyCodecState;
+static STR_FLIGHT_CATALOG_ENTRY copySummary;
+static STR_FLIGHT_TOTALS copyTotals;
+
+static const uint8_t* stagePtr(uint32_t pos) {
+  return reinterpret_cast<const uint8_t*>(XIP_BASE + stageStart + pos % stageSize);
+}
+
+static void stageRead(uint32_t pos, uint8_t* buf, uint32_t len) {
+  while (len > 0) {
+    pos %= stageSize;
+    const uint32_t n = min(len, stageSize - pos);
+    memcpy(buf, stagePtr(pos), n);
+    buf += n;
+    pos += n;
+    len -= n;
+  }
+}
+
+// Pages and sectors never wrap around the end of the stage
+static bool stageBlank(uint32_t pos, uint32_t len) {
+  const uint8_t* data = stagePtr(pos);
+  for (uint32_t i = 0; i < len; i++) {
+    if (data[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+static void stageProgram(uint32_t pos, const uint8_t* page) {
+  noInterrupts();
+  rp2040.idleOtherCore();
+  flash_range_program(stageStart + pos % stageSize, page, FLASH_PAGE_SIZE);
+  rp2040.resumeOtherCore();
+  interrupts();
+}
+
+static void stageErase(uint32_t pos) {
+  if (stageBlank(pos, FLASH_SECTOR_SIZE)) return;
+  noInterrupts();
+  rp2040.idleOtherCore();
+  flash_range_erase(stageStart + pos % stageSize, FLASH_SECTOR_SIZE);
+  rp2040.resumeOtherCore();
+  interrupts();
+}
+
+static bool readStagedHeader(uint32_t pos, STR_FLIGHT_LOG_HEADER* header) {
+  stageRead(pos, reinterpret_cast<uint8_t*>(header), sizeof(*header));
+  return header->magic == FLIGHT_LOG_MAGIC && header->version == FLIGHT_LOG_VERSION &&
+         header->recordSize == sizeof(STR_FLIGHT_RECORD_140);
+}
+
+// Bytes of the flight staged at pos, looking no further than limit
+static uint32_t stagedFlightLength(uint32_t pos, uint32_t limit) {
+  STR_FLIGHT_LOG_HEADER header;
+  uint32_t len = FLASH_PAGE_SIZE;
+  while (len < limit && !stageBlank(pos + len, FLASH_PAGE_SIZE) &&
+         !(len % FLASH_SECTOR_SIZE == 0 && readStagedHeader(pos + len, &header))) {
+    len += FLASH_PAGE_SIZE;
+  }
+  while (len > 0 && *stagePtr(pos + len - 1) == 0xFF) len--;
+  return len;
+}
+
+static uint32_t roundUpToSector(uint32_t bytes) {
+  return (bytes + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+}
+
+// Find the flights left to copy from before the last reset.
+// Returns the oldest of them, 0 if there are none.
+static uint32_t setupStage() {
+  const uint32_t binaryEnd = reinterpret_cast<uintptr_t>(&__flash_binary_end) - XIP_BASE;
+  stageStart = roundUpToSector(binaryEnd);
+  const uint32_t stageEnd = getJournalFlashOffset();
+  if (stageEnd < stageStart + FLIGHT_STAGE_MIN_SIZE) return 0;
+  stageSize = stageEnd - stageStart;
+
+  bool found = false;
+  uint32_t oldestPos = 0, newestPos = 0, oldest = 0, newest = 0;
+  for (uint32_t pos = 0; pos < stageSize; pos += FLASH_SECTOR_SIZE) {
+    STR_FLIGHT_LOG_HEADER header;
+    if (!readStagedHeader(pos, &header)) continue;
+    if (!found || header.flightNumber < oldest) {
+      oldest = header.flightNumber;
+      oldestPos = pos;
+    }
+    if (!found || header.flightNumber > newest) {
+      newest = header.flightNumber;
+      newestPos = pos;
+    }
+    found = true;
+  }
+  if (!found) return 0;
+  stageCopy = oldestPos;
+  const uint32_t newestOffset = (newestPos + stageSize - oldestPos) % stageSize;
+  stageUsed = roundUpToSector(newestOffset + stagedFlightLength(newestPos, stageSize - newestOffset));
+  if (newest >= nextFlightNumber) nextFlightNumber = newest + 1;
+  return oldest;
+}
+
+// Erase (or find erased) the next sector after the staged flights.
+// Returns false if there is nothing left to erase.
+static bool eraseAhead() {
+  if (stageUsed + stageErased >= stageSize) return false;
+  stageErase(stageCopy + stageUsed + stageErased);
+  stageErased += FLASH_SECTOR_SIZE;
+  return true;
+}
+
+// Program the next page of the flight being recorded. False if the stage is full.
+static bool stagePage(const uint8_t* page) {
+  if (stageErased < FLASH_PAGE_SIZE + FLIGHT_STAGE_GUARD) return false;
+  stageProgram(stageCopy + stageUsed, page);
+  stageUsed += FLASH_PAGE_SIZE;
+  stageErased -= FLASH_PAGE_SIZE;
+  return true;
+}
+
+// Skip to the next sector boundary, where the next flight will start
+static void finishStagedFlight() {
+  const uint32_t padding = roundUpToSector(stageUsed) - stageUsed;
+  stageUsed += padding;
+  stageErased -= padding;
+}
+
+// Forget the oldest staged flight. Erasing its header first means it is not
+// copied again after a reset; the rest is erased again later, ahead of a flight.
+static void releaseStagedFlight(uint32_t len) {
+  stageErase(stageCopy);
+  const uint32_t bytes = min(roundUpToSector(max(len, static_cast<uint32_t>(1))), stageUsed);
+  stageCopy = (stageCopy + bytes) % stageSize;
+  stageUsed -= bytes;
+}
+
+// Copy part of the oldest staged flight into its file, and summarize it for the catalog
+static void copyStagedFlight() {
+  if (copyFlightNumber == 0) {
+    STR_FLIGHT_LOG_HEADER header;
+    if (!readStagedHeader(stageCopy, &header)) {
+      releaseStagedFlight(FLASH_SECTOR_SIZE);
+      return;
+    }
+    copyLength = stagedFlightLength(stageCopy, stageUsed);
+    makeRoom(copyLength);
+    char path[32];
+    flightPath(header.flightNumber, path, sizeof(path));
+    if (readFile && readFlightNumber == header.flightNumber) readFile.close();
+    copyFile = LittleFS.open(path, "w");
+    if (!copyFile) {
+      releaseStagedFlight(copyLength);
+      return;
+    }
+    copyFlightNumber = header.flightNumber;
+    copyPos = 0;
+    decodePos = sizeof(header);
+    resetLogCodec(&copyCodecState);
+    copySummary = {};
+    copySummary.flightNumber = header.flightNumber;
+    copySummary.startMillis = header.startMillis;
+    copySummary.dataOffset = sizeof(header);
+    copySummary.dataBytes = copyLength - sizeof(header);
+    copyTotals = {};
+    return;
+  }
+
+  for (uint8_t i = 0; i < FLIGHT_LOG_COPY_CHUNKS && copyPos < copyLength; i++) {
+    uint8_t chunk[FLIGHT_LOG_CHUNK_SIZE];
+    const uint32_t len = min(copyLength - copyPos, static_cast<uint32_t>(FLIGHT_LOG_CHUNK_SIZE));
+    stageRead(stageCopy + copyPos, chunk, len);
+    if (copyFile.write(chunk, len) != len) {
+      // Filesystem full or broken: keep what fit
+      copyLength = copyPos;
+      copySummary.dataBytes = copyLength - sizeof(STR_FLIGHT_LOG_HEADER);
+      break;
+    }
+    copyPos += len;
+  }
+  while (decodePos < copyPos) {
+    uint8_t frame[LOG_CODEC_MAX_FRAME_SIZE];
+    const uint32_t len = min(copyLength - decodePos, static_cast<uint32_t>(sizeof(frame)));
+    stageRead(stageCopy + decodePos, frame, len);
+    STR_FLIGHT_RECORD_140 record;
+    const uint8_t used = decodeFlightRecord(&copyCodecState, frame, len, &record);
+    if (used == 0) {
+      decodePos = copyLength;  // A frame that can't be decoded, summarize up to here
+      break;
+    }
+    summarizeRecord(&copySummary, &copyTotals, record);
+    decodePos += used;
+  }
+  if (copyPos < copyLength) return;
+
+  copyFile.close();
+  finishSummary(&copySummary, copyTotals);
+  writeCatalogEntry(&copySummary);
+  copyFlightNumber = 0;
+  releaseStagedFlight(copyLength);
+  makeRoom(0);
+}
+
+// Move the next page of the RAM buffer to the stage
+static void writeStagedPage() {
+  const uint32_t used = (closing ? logEnd : logHead) - logTail;
+  if (used == 0 && closing) {
+    finishStagedFlight();
+    closing = false;
+    return;
+  }
+  // Write whole pages while flying, and the remainder once the flight is over
+  if (used == 0 || (used < FLIGHT_LOG_CHUNK_SIZE && !closing)) return;
+
+  uint8_t page[FLIGHT_LOG_CHUNK_SIZE];
+  const uint32_t len = min(used, static_cast<uint32_t>(FLIGHT_LOG_CHUNK_SIZE));
+  for (uint32_t i = 0; i < len; i++) page[i] = logBuffer[(logTail + i) % FLIGHT_LOG_BUFFER_SIZE];
+  memset(page + len, 0xFF, sizeof(page) - len);  // Programming 0xFF leaves flash erased
+  const uint32_t startMicros = micros();
+  const bool written = stagePage(page);
+  const uint32_t elapsedMicros = micros() - startMicros;
+  if (elapsedMicros > flightLogStats.maxWriteMicros) flightLogStats.maxWriteMicros = elapsedMicros;
+  if (!written) {
+    // Out of erased space: end the flight here, and any queued behind it
+    logTail = logHead;
+    logEnd = logHead;
+    logging = false;
+    closing = true;
+    return;
+  }
+  flightLogStats.bytesWritten += len;
+  logTail += len;
+}
+#endif  // RP_PIO
+
+static bool queueBytes(const uint8_t* data, uint32_t len) {
+  if (FLIGHT_LOG_BUFFER_SIZE - (logHead - logTail) < len) return false;
+  for (uint32_t i = 0; i < len; i++) {
+    logBuffer[(logHead + i) % FLIGHT_LOG_BUFFER_SIZE] = data[i];
+  }
+  logHead += len;
+  return true;
+}
+
+void setupFlightLog() {
+#ifdef RP_PIO
+  fsReady = LittleFS.begin();
+  if (!fsReady) return;
+  LittleFS.mkdir(FLIGHT_LOG_DIR);
+  uint32_t oldest, newest;
+  const bool found = findFlights(&oldest, &newest);
+  if (found) nextFlightNumber = newest + 1;
+  const uint32_t oldestStaged = setupStage();
+  // A file that is still staged is copied again instead
+  STR_FLIGHT_CATALOG_ENTRY entry;
+  if (found && (oldestStaged == 0 || newest < oldestStaged) && !getFlightSummary(newest, &entry)) {
+    rebuildCatalogEntry(newest);
+  }
+  makeRoom(0);
+#endif
+}
+
+void startFlightLog() {
+  if (!fsReady) return;
+  // The last flight may still be draining (closing). Its bytes stay ahead of
+  // this one's in the buffer, and the writer finishes it first.
+  flying = true;
+  flightLogStats = {};
+
+  STR_FLIGHT_LOG_HEADER header;
+  header.magic = FLIGHT_LOG_MAGIC;
+  header.version = FLIGHT_LOG_VERSION;
+  header.recordSize = sizeof(STR_FLIGHT_RECORD_140);
+  header.intervalMs = FLIGHT_LOG_INTERVAL;
+  header.flightNumber = nextFlightNumber;
+  header.startMillis = millis();
+  header.version_major = VERSION_MAJOR;
+  header.version_minor = VERSION_MINOR;
+
+  resetLogCodec(&codecState);
+  nextRecordMillis = header.startMillis;
+
+#ifdef RP_PIO
+  // Only the erased part of the stage can be written while flying
+  logging = stageErased >= FLIGHT_STAGE_GUARD + FLASH_SECTOR_SIZE &&
+            queueBytes(reinterpret_cast<uint8_t*>(&header), sizeof(header));
+  // A flight that is not recorded doesn't use up a number
+  if (logging) flightLogStats.flightNumber = nextFlightNumber++;
+#endif
+}
+
+void stopFlightLog() {
+  flying = false;
+  if (!logging) return;
+  logging = false;
+  closing = true;
+  logEnd = logHead;
+}
+
+void logFlightRecord(const STR_FLIGHT_RECORD_140& record) {
+  if (!logging) return;
+  if (static_cast<int32_t>(record.millis - nextRecordMillis) < 0) return;
+  nextRecordMillis += FLIGHT_LOG_INTERVAL;
+  // Don't try to catch up after a gap
+  if (static_cast<int32_t>(record.millis - nextRecordMillis) > 0) nextRecordMillis = record.millis;
+
+  // Check for room first: the decoder can't skip a frame that was never stored.
+  if (FLIGHT_LOG_BUFFER_SIZE - (logHead - logTail) < LOG_CODEC_MAX_FRAME_SIZE) {
+    flightLogStats.dropped++;
+    resetLogCodec(&codecState);  // Restart with a keyframe
+    return;
+  }
+  uint8_t frame[LOG_CODEC_MAX_FRAME_SIZE];
+  const uint8_t frameSize = encodeFlightRecord(&codecState, record, frame);
+  queueBytes(frame, frameSize);
+  flightLogStats.records++;
+}
+
+void serviceFlightLog() {
+#ifdef RP_PIO
+  if (!fsReady || stageSize == 0) return;
+  if (flying || closing) {
+    writeStagedPage();
+    return;
+  }
+  // Disarmed: keep some space erased for a quick re-arm, then copy, then erase the rest
+  if (stageErased < FLIGHT_STAGE_RESERVE && eraseAhead()) return;
+  if (stageUsed > 0) {
+    copyStagedFlight();
+    return;
+  }
+  eraseAhead();
+#endif
+}
+
+const STR_FLIGHT_LOG_STATS& getFlightLogStats() {
+  return flightLogStats;
+}
+
+bool getFlightRange(uint32_t* oldest, uint32_t* newest) {
+  if (oldestFlightNumber == 0) return false;
+  *oldest = oldestFlightNumber;
+  *newest = newestFlightNumber;
+  return true;
+}
+
+bool isFlightCopyPending() {
+#ifdef RP_PIO
+  return closing || stageUsed > 0;
+#else
+  return false;
+#endif
+}
+
+bool getFlightSummary(uint32_t flightNumber, STR_FLIGHT_CATALOG_ENTRY* entry) {
+  if (!fsReady || flightNumber == 0) return false;
+#ifdef RP_PIO
+  File catalog = LittleFS.open(FLIGHT_CATALOG_PATH, "r");
+  if (!catalog) return false;
+  bool ok = catalog.seek((flightNumber - 1) * sizeof(*entry)) &&
+            catalog.read(reinterpret_cast<uint8_t*>(entry), sizeof(*entry)) == sizeof(*entry);
+  catalog.close();
+  ok = ok && entry->flightNumber == flightNumber &&
+       entry->crc == crc16(reinterpret_cast<uint8_t*>(entry), sizeof(*entry) - 2);
+  return ok;
+#else
+  return false;
+#endif
+}
+
+#ifdef RP_PIO
+// Open a finished flight file (or the catalog) for reading, unless it already is
+static bool openReadFile(uint32_t flightNumber) {
+  // The flight being copied from the stage isn't complete yet
+  if (copyFlightNumber != 0 && flightNumber == copyFlightNumber) return false;
+  if (readFile && readFlightNumber == flightNumber) return true;
+  if (readFile) readFile.close();
+  char path[32];
+  if (flightNumber == 0) {
+    snprintf(path, sizeof(path), FLIGHT_CATALOG_PATH);
+  } else {
+    flightPath(flightNumber, path, sizeof(path));
+  }
+  readFile = LittleFS.open(path, "r");
+  if (!readFile) return false;
+  readFlightNumber = flightNumber;
+  return true;
+}
+#endif
+
+int32_t readFlightFile(uint32_t flightNumber, uint32_t offset, uint8_t* buf, uint32_t len) {
+  if (!fsReady) return -1;
+#ifdef RP_PIO
+  if (!openReadFile(flightNumber)) return -1;
+  if (offset >= readFile.size()) return 0;
+  if (readFile.position() != offset && !readFile.seek(offset)) return -1;
+  return readFile.read(buf, len);
+#else
+  return -1;
+#endif
+}
+
+int32_t getFlightFileSize(uint32_t flightNumber) {
+  if (!fsReady) return -1;
+#ifdef RP_PIO
+  if (!openReadFile(flightNumber)) return -1;
+  return readFile.size();
+#else
+  return -1;
+#endif
+}
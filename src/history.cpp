@@ -0,0 +1,102 @@
+#include "sp140/history.h"
+
+#include "sp140/config.h"
+
+#include <Arduino.h>
+
+// Samples of a bucket that is still open
+typedef struct {
+  int16_t min;
+  int16_t max;
+  int32_t sum;
+  uint16_t count;  // Raw samples, 30000 in 10 min at the ESC rate
+} STR_HISTORY_ACCUMULATOR;
+
+static const uint32_t kBucketMillis[HISTORY_LEVELS] = {1000, 10000, 60000, 600000};
+
+static STR_HISTORY_BUCKET buckets[HISTORY_SERIES][HISTORY_LEVELS][HISTORY_SLOTS];
+static STR_HISTORY_ACCUMULATOR openBuckets[HISTORY_SERIES][HISTORY_LEVELS];
+static uint8_t head[HISTORY_LEVELS];     // Next slot to fill
+static uint32_t closed[HISTORY_LEVELS];  // Buckets closed since the reset
+static uint32_t bucketStartMillis = 0;   // Of the open 1 s bucket
+
+static void clearAccumulator(STR_HISTORY_ACCUMULATOR* acc) {
+  acc->min = INT16_MAX;
+  acc->max = INT16_MIN;
+  acc->sum = 0;
+  acc->count = 0;
+}
+
+// Store the open bucket of every series, fold it into the level above,
+// and close that one too when it is complete.
+static void closeLevel(uint8_t level) {
+  for (uint8_t series = 0; series < HISTORY_SERIES; series++) {
+    STR_HISTORY_ACCUMULATOR* acc = &openBuckets[series][level];
+    STR_HISTORY_BUCKET* bucket = &buckets[series][level][head[level]];
+    bucket->min = acc->min;
+    bucket->max = acc->max;
+    bucket->avg = acc->count > 0 ? acc->sum / acc->count : 0;
+    if (level + 1 < HISTORY_LEVELS && acc->count > 0) {
+      STR_HISTORY_ACCUMULATOR* parent = &openBuckets[series][level + 1];
+      if (acc->min < parent->min) parent->min = acc->min;
+      if (acc->max > parent->max) parent->max = acc->max;
+      parent->sum += acc->sum;
+      parent->count += acc->count;
+    }
+    clearAccumulator(acc);
+  }
+  head[level] = (head[level] + 1) % HISTORY_SLOTS;
+  closed[level]++;
+  if (level + 1 < HISTORY_LEVELS && closed[level] % (kBucketMillis[level + 1] / kBucketMillis[level]) == 0) {
+    closeLevel(level + 1);
+  }
+}
+
+void resetHistory() {
+  for (uint8_t series = 0; series < HISTORY_SERIES; series++) {
+    for (uint8_t level = 0; level < HISTORY_LEVELS; level++) {
+      clearAccumulator(&openBuckets[series][level]);
+    }
+  }
+  for (uint8_t level = 0; level < HISTORY_LEVELS; level++) {
+    head[level] = 0;
+    closed[level] = 0;
+  }
+  bucketStartMillis = millis();
+}
+
+void RAM_FUNC(addHistorySample)(uint8_t series, int32_t value) {
+  const int16_t sample = constrain(value, INT16_MIN, INT16_MAX);
+  STR_HISTORY_ACCUMULATOR* acc = &openBuckets[series][0];
+  if (sample < acc->min) acc->min = sample;
+  if (sample > acc->max) acc->max = sample;
+  acc->sum += sample;
+  acc->count++;
+}
+
+void updateHistory() {
+  const uint32_t nowMillis = millis();
+  while (nowMillis - bucketStartMillis >= kBucketMillis[0]) {
+    bucketStartMillis += kBucketMillis[0];
+    closeLevel(0);
+  }
+}
+
+uint32_t getHistoryBucketMillis(uint8_t level) {
+  return kBucketMillis[level];
+}
+
+uint8_t getHistoryCount(uint8_t level) {
+  return min(closed[level], static_cast<uint32_t>(HISTORY_SLOTS));
+}
+
+const STR_HISTORY_BUCKET& getHistoryBucket(uint8_t series, uint8_t level, uint8_t age) {
+  return buckets[series][level][(head[level] + HISTORY_SLOTS - 1 - age) % HISTORY_SLOTS];
+}
+
+uint8_t getHistoryLevel() {
+  for (uint8_t level = 0; level < HISTORY_LEVELS - 1; level++) {
+    if (closed[level] <= HISTORY_SLOTS) return level;
+  }
+  return HISTORY_LEVELS - 1;
+}
@@ -0,0 +1,61 @@
+#include "sp140/i2c_bus.h"
+
+#ifdef RP_PIO
+  #include <Wire.h>
+  #include "sp140/clock.h"
+
+  #define I2C_HZ  100000  // The Wire default, used by the Adafruit drivers
+#endif
+
+#define I2C_QUEUE_SIZE  8  // jobs, power of 2
+
+typedef struct {
+  I2cJobFunction run;
+  I2cJobFunction done;
+  void* context;
+} I2C_JOB;
+
+// Single producer (core0), single consumer (core1 on the RP2040), so each
+// side only writes its own index.
+static I2C_JOB jobQueue[I2C_QUEUE_SIZE];
+static volatile uint8_t jobHead = 0;
+static volatile uint8_t jobTail = 0;
+static volatile bool busStarted = false;
+
+#ifdef RP_PIO
+static uint32_t busKhz = 0;  // CPU clock the I2C baud rate was last set for
+#endif
+
+bool postI2cJob(I2cJobFunction run, I2cJobFunction done, void* context) {
+  if (static_cast<uint8_t>(jobHead - jobTail) >= I2C_QUEUE_SIZE) return false;
+  I2C_JOB& job = jobQueue[jobHead % I2C_QUEUE_SIZE];
+  job.run = run;
+  job.done = done;
+  job.context = context;
+  __sync_synchronize();  // Store the job before publishing it
+  jobHead = jobHead + 1;
+  return true;
+}
+
+void startI2cBus() {
+  busStarted = true;
+}
+
+bool serviceI2cBus() {
+  if (!busStarted || jobTail == jobHead) return false;
+  const I2C_JOB job = jobQueue[jobTail % I2C_QUEUE_SIZE];
+  __sync_synchronize();  // Read the job before freeing its slot
+  jobTail = jobTail + 1;
+#ifdef RP_PIO
+  // I2C runs from the CPU clock. Set the baud rate again after core0
+  // changed the clock, here between transfers rather than during one.
+  const uint32_t khz = getCpuKhz();
+  if (khz != busKhz) {
+    Wire.setClock(I2C_HZ);
+    busKhz = khz;
+  }
+#endif
+  job.run(job.context);
+  if (job.done) job.done(job.context);
+  return true;
+}
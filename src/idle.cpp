@@ -0,0 +1,55 @@
+#include "sp140/idle.h"
+
+#include "sp140/config.h"
+#include "sp140/profiler.h"
+
+#include <Arduino.h>
+
+#ifdef RP_PIO
+  #include <hardware/irq.h>
+  #include <hardware/structs/timer.h>
+  #include <hardware/sync.h>
+  #include <hardware/timer.h>
+
+  #define MIN_SLEEP_MICROS  20  // Not worth arming the alarm for less
+
+static int wakeAlarm = -1;
+
+// The alarm only has to wake the core
+static void RAM_FUNC(wakeIrq)() {
+  timer_hw->intr = 1u << wakeAlarm;
+}
+#endif
+
+void setupIdle() {
+#ifdef RP_PIO
+  wakeAlarm = hardware_alarm_claim_unused(false);
+  if (wakeAlarm < 0) return;  // Keep polling
+  irq_set_exclusive_handler(TIMER_IRQ_0 + wakeAlarm, wakeIrq);
+  hw_set_bits(&timer_hw->inte, 1u << wakeAlarm);
+  irq_set_enabled(TIMER_IRQ_0 + wakeAlarm, true);
+#endif
+}
+
+void idleUntil(uint32_t wakeMillis) {
+  const int32_t remainingMillis = static_cast<int32_t>(wakeMillis - millis());
+  if (remainingMillis <= 0) return;
+  const uint32_t startMicros = micros();
+#ifdef RP_PIO
+  if (wakeAlarm < 0) return;
+  // millis() is time_us_64() / 1000, so that millisecond starts at a multiple of 1000 us
+  const uint64_t wakeMicros = (time_us_64() / 1000 + remainingMillis) * 1000;
+  timer_hw->alarm[wakeAlarm] = static_cast<uint32_t>(wakeMicros);
+  // With interrupts masked, one that is already pending ends the WFI at once.
+  // It runs when they are enabled again, so no wake-up is lost.
+  const uint32_t status = save_and_disable_interrupts();
+  if (time_us_64() + MIN_SLEEP_MICROS < wakeMicros) __wfi();
+  restore_interrupts(status);
+  timer_hw->armed = 1u << wakeAlarm;  // Disarm, if something else woke the core
+#elif M0_PIO
+  __WFI();  // SysTick wakes the core within a millisecond
+#elif SIL_PIO
+  delayMicroseconds(remainingMillis * 1000 - micros() % 1000);
+#endif
+  recordCpuIdle(micros() - startMicros);
+}
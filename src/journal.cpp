@@ -0,0 +1,305 @@
+#include "sp140/journal.h"
+
+#include "sp140/config.h"
+#include "sp140/device_data.h"
+
+#include <Arduino.h>
+
+// Hardware-specific libraries
+#ifdef M0_PIO
+  #include <extEEPROM.h>  // https://github.com/PaoloP74/extEEPROM
+#elif RP_PIO
+  #include <hardware/flash.h>
+#endif
+
+#ifdef M0_PIO
+  // 8 kB I2C EEPROM. The first sector holds the legacy (pre-journal) record.
+  #define JOURNAL_SECTOR_SIZE   1024
+  #define JOURNAL_SECTOR_COUNT  7
+  #define JOURNAL_START         JOURNAL_SECTOR_SIZE
+  extEEPROM eep(kbits_64, 1, 64);
+#elif RP_PIO
+  // The last flash sectors of the program area, just below the filesystem.
+  // Firmware updates only rewrite the program image, so the journal survives.
+  #define JOURNAL_SECTOR_SIZE   FLASH_SECTOR_SIZE
+  #define JOURNAL_SECTOR_COUNT  4
+  #define JOURNAL_START         (reinterpret_cast<uintptr_t>(&_FS_start) - XIP_BASE \
+                                 - JOURNAL_SECTOR_COUNT * JOURNAL_SECTOR_SIZE)
+  extern uint8_t _FS_start;
+  extern uint8_t _EEPROM_start;
+  extern uint8_t __flash_binary_end;
+#elif SIL_PIO
+  // Simulator (tools/sil): RAM, lost when the simulation ends
+  #define JOURNAL_SECTOR_SIZE   1024
+  #define JOURNAL_SECTOR_COUNT  4
+  static uint8_t simStorage[JOURNAL_SECTOR_COUNT * JOURNAL_SECTOR_SIZE];
+#endif
+
+#define JOURNAL_MAGIC            0x314A5053  // "SPJ1"
+#define JOURNAL_END              0xFF        // Erased storage reads as 0xFF
+#define JOURNAL_RECORD_OVERHEAD  4           // offset, length and crc16
+// Compact in the background once less than this much space is left
+#define JOURNAL_COMPACT_RESERVE  (JOURNAL_SECTOR_SIZE / 4)
+
+#pragma pack(push, 1)
+typedef struct {
+  uint32_t magic;
+  uint32_t seq;  // Incremented on every compaction, the highest valid one wins
+} STR_JOURNAL_HEADER;
+#pragma pack(pop)
+
+enum JournalRecordStatus { RECORD_VALID, RECORD_END, RECORD_BAD };
+
+static uint8_t persisted[JOURNAL_MAX_IMAGE_SIZE];  // Last image on storage
+static uint8_t imageSize = 0;
+static bool storageOk = false;
+static bool mounted = false;
+static bool damaged = false;  // Garbage after the last good record
+static uint16_t activeSector = 0;
+static uint32_t activeSeq = 0;
+static uint32_t maxSeq = 0;
+static uint32_t writePos = 0;  // Offset of the next record in the active sector
+
+//
+// Storage backends. Addresses are relative to the start of the journal.
+//
+
+static bool storageRead(uint32_t addr, uint8_t* buf, uint16_t len) {
+#ifdef M0_PIO
+  return eep.read(JOURNAL_START + addr, buf, len) == 0;
+#elif RP_PIO
+  memcpy(buf, reinterpret_cast<const uint8_t*>(XIP_BASE + JOURNAL_START + addr), len);
+  return true;
+#elif SIL_PIO
+  memcpy(buf, simStorage + addr, len);
+  return true;
+#endif
+}
+
+static bool storageWrite(uint32_t addr, const uint8_t* buf, uint16_t len) {
+#ifdef M0_PIO
+  return eep.write(JOURNAL_START + addr, const_cast<uint8_t*>(buf), len) == 0;
+#elif RP_PIO
+  // Flash is programmed a whole page at a time. Bytes outside the record are
+  // reprogrammed with their current value, which leaves them unchanged.
+  uint8_t page[FLASH_PAGE_SIZE];
+  while (len > 0) {
+    const uint32_t pageAddr = addr - (addr % FLASH_PAGE_SIZE);
+    const uint16_t pageOffset = addr - pageAddr;
+    const uint16_t chunk = min(static_cast<uint32_t>(len), FLASH_PAGE_SIZE - pageOffset);
+    storageRead(pageAddr, page, FLASH_PAGE_SIZE);
+    memcpy(page + pageOffset, buf, chunk);
+    noInterrupts();
+    rp2040.idleOtherCore();
+    flash_range_program(JOURNAL_START + pageAddr, page, FLASH_PAGE_SIZE);
+    rp2040.resumeOtherCore();
+    interrupts();
+    addr += chunk;
+    buf += chunk;
+    len -= chunk;
+  }
+  return true;
+#elif SIL_PIO
+  memcpy(simStorage + addr, buf, len);
+  return true;
+#endif
+}
+
+static bool storageErase(uint16_t sector) {
+  const uint32_t addr = sector * JOURNAL_SECTOR_SIZE;
+#ifdef M0_PIO
+  uint8_t blank[64];
+  memset(blank, JOURNAL_END, sizeof(blank));
+  for (uint32_t i = 0; i < JOURNAL_SECTOR_SIZE; i += sizeof(blank)) {
+    if (!storageWrite(addr + i, blank, sizeof(blank))) return false;
+  }
+  return true;
+#elif RP_PIO
+  noInterrupts();
+  rp2040.idleOtherCore();
+  flash_range_erase(JOURNAL_START + addr, JOURNAL_SECTOR_SIZE);
+  rp2040.resumeOtherCore();
+  interrupts();
+  return true;
+#elif SIL_PIO
+  memset(simStorage + addr, JOURNAL_END, JOURNAL_SECTOR_SIZE);
+  return true;
+#endif
+}
+
+//
+// Records: [offset][length][data...][crc16 lo][crc16 hi]
+// The crc also covers the sector seq, so stale records from an earlier use of
+// the sector never validate.
+//
+
+static uint16_t recordCrc(uint32_t seq, const uint8_t* record, uint8_t length) {
+  uint8_t buf[sizeof(seq) + 2 + JOURNAL_MAX_IMAGE_SIZE];
+  memcpy(buf, &seq, sizeof(seq));
+  memcpy(buf + sizeof(seq), record, length + 2);
+  return crc16(buf, sizeof(seq) + 2 + length);
+}
+
+static uint16_t encodeRecord(uint32_t seq, uint8_t offset, uint8_t length, const uint8_t* data, uint8_t* out) {
+  out[0] = offset;
+  out[1] = length;
+  memcpy(out + 2, data, length);
+  const uint16_t crc = recordCrc(seq, out, length);
+  out[2 + length] = crc & 0xFF;
+  out[3 + length] = crc >> 8;
+  return length + JOURNAL_RECORD_OVERHEAD;
+}
+
+static JournalRecordStatus readRecord(uint16_t sector, uint32_t pos, uint32_t seq,
+                                      uint8_t* offset, uint8_t* length, uint8_t* data) {
+  uint8_t record[JOURNAL_MAX_IMAGE_SIZE + JOURNAL_RECORD_OVERHEAD];
+  const uint32_t addr = sector * JOURNAL_SECTOR_SIZE + pos;
+  if (pos + 2 > JOURNAL_SECTOR_SIZE) return RECORD_END;
+  if (!storageRead(addr, record, 2)) return RECORD_BAD;
+  if (record[0] == JOURNAL_END && record[1] == JOURNAL_END) return RECORD_END;
+  *offset = record[0];
+  *length = record[1];
+  if (*length == 0 || *offset + *length > imageSize) return RECORD_BAD;
+  if (pos + *length + JOURNAL_RECORD_OVERHEAD > JOURNAL_SECTOR_SIZE) return RECORD_BAD;
+  if (!storageRead(addr + 2, record + 2, *length + 2)) return RECORD_BAD;
+  const uint16_t crc = word(record[3 + *length], record[2 + *length]);
+  if (crc != recordCrc(seq, record, *length)) return RECORD_BAD;
+  memcpy(data, record + 2, *length);
+  return RECORD_VALID;
+}
+
+// Start a fresh sector holding a snapshot of image
+static bool compactInto(const uint8_t* image) {
+  const uint16_t sector = mounted ? (activeSector + 1) % JOURNAL_SECTOR_COUNT : 0;
+  const uint32_t seq = maxSeq + 1;
+  uint8_t buf[sizeof(STR_JOURNAL_HEADER) + JOURNAL_MAX_IMAGE_SIZE + JOURNAL_RECORD_OVERHEAD];
+  STR_JOURNAL_HEADER header = {JOURNAL_MAGIC, seq};
+  memcpy(buf, &header, sizeof(header));
+  const uint16_t len = sizeof(header) + encodeRecord(seq, 0, imageSize, image, buf + sizeof(header));
+
+  // The previous sector stays valid until this one is completely written.
+  if (!storageErase(sector) || !storageWrite(sector * JOURNAL_SECTOR_SIZE, buf, len)) {
+    return false;
+  }
+  if (image != persisted) memcpy(persisted, image, imageSize);
+  mounted = true;
+  damaged = false;
+  activeSector = sector;
+  activeSeq = seq;
+  maxSeq = seq;
+  writePos = len;
+  return true;
+}
+
+//
+// Public API
+//
+
+void setupJournal() {
+#ifdef M0_PIO
+  storageOk = eep.begin(eep.twiClock100kHz) == 0;
+#elif RP_PIO
+  // Only usable if the firmware image doesn't reach into the journal.
+  storageOk = reinterpret_cast<uintptr_t>(&__flash_binary_end) <= XIP_BASE + JOURNAL_START;
+#elif SIL_PIO
+  memset(simStorage, JOURNAL_END, sizeof(simStorage));
+  storageOk = true;
+#endif
+}
+
+bool journalMount(uint8_t* image, uint8_t size) {
+  mounted = false;
+  damaged = false;
+  if (!storageOk || size == 0 || size > JOURNAL_MAX_IMAGE_SIZE) return false;
+  imageSize = size;
+
+  // Find the newest sector with a valid snapshot
+  uint8_t offset, length;
+  for (uint16_t s = 0; s < JOURNAL_SECTOR_COUNT; s++) {
+    STR_JOURNAL_HEADER header;
+    if (!storageRead(s * JOURNAL_SECTOR_SIZE, reinterpret_cast<uint8_t*>(&header), sizeof(header))) continue;
+    if (header.magic != JOURNAL_MAGIC) continue;
+    if (header.seq > maxSeq) maxSeq = header.seq;
+    if (mounted && header.seq <= activeSeq) continue;
+    if (readRecord(s, sizeof(header), header.seq, &offset, &length, persisted) != RECORD_VALID) continue;
+    if (offset != 0 || length != size) continue;
+    mounted = true;
+    activeSector = s;
+    activeSeq = header.seq;
+  }
+  if (!mounted) return false;
+
+  // Replay the snapshot and the changes that follow it
+  uint8_t data[JOURNAL_MAX_IMAGE_SIZE];
+  uint32_t pos = sizeof(STR_JOURNAL_HEADER);
+  JournalRecordStatus status;
+  while ((status = readRecord(activeSector, pos, activeSeq, &offset, &length, data)) == RECORD_VALID) {
+    memcpy(persisted + offset, data, length);
+    pos += length + JOURNAL_RECORD_OVERHEAD;
+  }
+  writePos = pos;
+  // A torn write leaves garbage after the last good record. Never append after it.
+  damaged = status == RECORD_BAD;
+  memcpy(image, persisted, size);
+  return true;
+}
+
+bool journalRead(uint8_t* image, uint8_t size) {
+  if (!mounted || size != imageSize) return false;
+  memcpy(image, persisted, size);
+  return true;
+}
+
+bool journalWrite(const uint8_t* image, uint8_t size) {
+  if (!storageOk || size == 0 || size > JOURNAL_MAX_IMAGE_SIZE) return false;
+  if (!mounted || size != imageSize) {
+    imageSize = size;
+    return compactInto(image);
+  }
+  if (damaged) return compactInto(image);
+
+  // Only store the range of bytes that changed
+  uint8_t first = 0;
+  while (first < size && image[first] == persisted[first]) first++;
+  if (first == size) return true;  // Nothing to do
+  uint8_t last = size - 1;
+  while (image[last] == persisted[last]) last--;
+  const uint8_t length = last - first + 1;
+
+  if (writePos + length + JOURNAL_RECORD_OVERHEAD > JOURNAL_SECTOR_SIZE) return compactInto(image);
+
+  uint8_t record[JOURNAL_MAX_IMAGE_SIZE + JOURNAL_RECORD_OVERHEAD];
+  const uint16_t len = encodeRecord(activeSeq, first, length, image + first, record);
+  if (!storageWrite(activeSector * JOURNAL_SECTOR_SIZE + writePos, record, len)) {
+    damaged = true;
+    return false;
+  }
+  memcpy(persisted + first, image + first, length);
+  writePos += len;
+  return true;
+}
+
+bool journalNeedsCompaction() {
+  return mounted && (damaged || writePos + JOURNAL_COMPACT_RESERVE > JOURNAL_SECTOR_SIZE);
+}
+
+bool journalCompact() {
+  if (!storageOk || !mounted) return false;
+  return compactInto(persisted);
+}
+
+void journalReadLegacy(uint8_t* image, uint8_t size) {
+#ifdef M0_PIO
+  eep.read(0, image, size);
+#elif RP_PIO
+  memcpy(image, &_EEPROM_start, size);
+#elif SIL_PIO
+  memset(image, 0xFF, size);
+#endif
+}
+
+#ifdef RP_PIO
+uint32_t getJournalFlashOffset() {
+  return JOURNAL_START;
+}
+#endif
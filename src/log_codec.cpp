@@ -0,0 +1,136 @@
+#include "sp140/log_codec.h"
+
+#include <math.h>
+
+#define NO_KEYFRAME  0xFFFF
+
+#define NO_ALTITUDE       INT32_MIN  // Quantized __FLT_MIN__ (no altimeter)
+
+// Altitude is stored in 0.1 m
+static int32_t quantizeAltitude(float meters) {
+  if (meters == __FLT_MIN__) return NO_ALTITUDE;
+  return lroundf(meters * 10);
+}
+
+static float dequantizeAltitude(int32_t decimeters) {
+  if (decimeters == NO_ALTITUDE) return __FLT_MIN__;
+  return decimeters / 10.0f;
+}
+
+// Energy is stored in 0.01 Wh
+static int32_t roundToTens(int32_t value) {
+  return (value >= 0 ? value + 5 : value - 5) / 10;
+}
+
+// Field order and units of the stored format. The telemetry fields are
+// already fixed-point, only energy and altitude change resolution.
+static void getFields(const STR_FLIGHT_RECORD_140& r, int32_t* v) {
+  v[0] = static_cast<int32_t>(r.millis);
+  v[1] = r.throttlePWM;
+  v[2] = r.centiVolts;
+  v[3] = r.deciCelsius;
+  v[4] = r.centiAmps;
+  v[5] = r.watts;
+  v[6] = roundToTens(r.milliwattHours);
+  v[7] = static_cast<int32_t>(r.rpm);
+  v[8] = r.inPWM;
+  v[9] = r.outPWM;
+  v[10] = r.statusFlag;
+  v[11] = quantizeAltitude(r.altitude);
+  v[12] = r.stateFlags;
+}
+
+static void setFields(const int32_t* v, STR_FLIGHT_RECORD_140* r) {
+  r->millis = static_cast<uint32_t>(v[0]);
+  r->throttlePWM = v[1];
+  r->centiVolts = v[2];
+  r->deciCelsius = v[3];
+  r->centiAmps = v[4];
+  r->watts = v[5];
+  r->milliwattHours = v[6] * 10;
+  r->rpm = static_cast<uint32_t>(v[7]);
+  r->inPWM = v[8];
+  r->outPWM = v[9];
+  r->statusFlag = v[10];
+  r->altitude = dequantizeAltitude(v[11]);
+  r->stateFlags = v[12];
+}
+
+// Zig-zag maps small negative and positive numbers to small unsigned ones
+static uint8_t putVarint(int32_t value, uint8_t* out) {
+  uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+  uint8_t n = 0;
+  while (zigzag >= 0x80) {
+    out[n++] = (zigzag & 0x7F) | 0x80;
+    zigzag >>= 7;
+  }
+  out[n++] = zigzag;
+  return n;
+}
+
+static uint8_t getVarint(const uint8_t* in, uint32_t len, int32_t* value) {
+  uint32_t zigzag = 0;
+  for (uint8_t n = 0; n < 5 && n < len; n++) {
+    zigzag |= static_cast<uint32_t>(in[n] & 0x7F) << (7 * n);
+    if ((in[n] & 0x80) == 0) {
+      *value = static_cast<int32_t>((zigzag >> 1) ^ (0 - (zigzag & 1)));
+      return n + 1;
+    }
+  }
+  return 0;  // Truncated or too long
+}
+
+void resetLogCodec(STR_LOG_CODEC_STATE* state) {
+  for (uint8_t i = 0; i < LOG_CODEC_FIELD_COUNT; i++) state->prev[i] = 0;
+  state->sinceKeyframe = NO_KEYFRAME;
+}
+
+uint8_t encodeFlightRecord(STR_LOG_CODEC_STATE* state, const STR_FLIGHT_RECORD_140& record, uint8_t* out) {
+  int32_t values[LOG_CODEC_FIELD_COUNT];
+  getFields(record, values);
+
+  const bool keyframe = state->sinceKeyframe >= LOG_CODEC_KEYFRAME_INTERVAL;
+  uint16_t mask = keyframe ? LOG_CODEC_KEYFRAME : 0;
+  uint8_t len = 2;
+  for (uint8_t i = 0; i < LOG_CODEC_FIELD_COUNT; i++) {
+    // Wrapping difference, so millis and the sentinels never overflow
+    const int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(values[i]) - static_cast<uint32_t>(state->prev[i]));
+    if (keyframe) {
+      len += putVarint(values[i], out + len);
+    } else if (delta != 0) {
+      mask |= 1 << i;
+      len += putVarint(delta, out + len);
+    }
+    state->prev[i] = values[i];
+  }
+  out[0] = mask & 0xFF;
+  out[1] = mask >> 8;
+  state->sinceKeyframe = keyframe ? 1 : state->sinceKeyframe + 1;
+  return len;
+}
+
+uint8_t decodeFlightRecord(STR_LOG_CODEC_STATE* state, const uint8_t* in, uint32_t len,
+                           STR_FLIGHT_RECORD_140* record) {
+  if (len < 2) return 0;
+  const uint16_t mask = in[0] | (in[1] << 8);
+  const bool keyframe = mask & LOG_CODEC_KEYFRAME;
+  if (!keyframe && state->sinceKeyframe == NO_KEYFRAME) return 0;
+
+  int32_t values[LOG_CODEC_FIELD_COUNT];
+  uint8_t pos = 2;
+  for (uint8_t i = 0; i < LOG_CODEC_FIELD_COUNT; i++) {
+    values[i] = state->prev[i];
+    if (!keyframe && !(mask & (1 << i))) continue;
+    int32_t value;
+    const uint8_t n = getVarint(in + pos, len - pos, &value);
+    if (n == 0) return 0;
+    pos += n;
+    values[i] = keyframe ? value : static_cast<int32_t>(static_cast<uint32_t>(values[i]) + static_cast<uint32_t>(value));
+  }
+
+  for (uint8_t i = 0; i < LOG_CODEC_FIELD_COUNT; i++) state->prev[i] = values[i];
+  if (keyframe) state->sinceKeyframe = 1;
+  else if (state->sinceKeyframe < LOG_CODEC_KEYFRAME_INTERVAL) state->sinceKeyframe++;
+  setFields(values, record);
+  return pos;
+}
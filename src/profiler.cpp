@@ -0,0 +1,245 @@
+#include "sp140/profiler.h"
+
+#include "sp140/config.h"
+
+#include <Arduino.h>
+
+#ifdef RP_PIO
+  #include <hardware/irq.h>
+  #include <hardware/structs/timer.h>
+  #include <hardware/timer.h>
+  #define PROFILER_SAMPLING
+  #define PROFILER_SLOT_BITS   8
+  #define PROFILER_SLOTS       (1 << PROFILER_SLOT_BITS)
+  #define PROFILER_PROBES      8  // Give up on a pc after this many occupied slots
+  #define PROFILER_IRQ_PRIORITY  0x40  // Above the default, so other interrupts are sampled too
+#else
+  #define PROFILER_SLOTS       0
+#endif
+
+#define PROFILER_MAX_HZ      10000
+#define LOAD_WINDOW_MILLIS   1000
+
+typedef struct {
+  uint32_t samples;
+  uint32_t runs;
+  uint64_t busyMicros;
+} PROFILER_TASK;
+
+static const char* const* taskNames = nullptr;
+static uint8_t taskCount = 0;  // Named tasks, not counting PROFILER_TASK_LOOP
+static PROFILER_TASK tasks[PROFILER_MAX_TASKS];
+static volatile uint8_t currentTask = PROFILER_TASK_LOOP;
+static uint32_t taskStartMicros = 0;
+
+static uint16_t sampleHz = 0;
+static volatile uint32_t samples = 0;
+static volatile uint32_t droppedSamples = 0;
+static uint32_t profileStartMillis = 0;
+
+// Busy time per core, free-running. Each core only writes its own.
+static volatile uint32_t busyMicros[2];
+static uint32_t windowBusyMicros[2];
+static uint32_t idleMicros = 0;  // Core 0 asleep, free-running
+static uint32_t windowIdleMicros = 0;
+static uint32_t windowStartMicros = 0;
+static STR_CPU_LOAD cpuLoad;
+
+// Snapshot for download
+static uint8_t snapshot[sizeof(STR_PROFILE_HEADER) + PROFILER_MAX_TASKS * sizeof(STR_PROFILE_TASK) +
+                        PROFILER_SLOTS * sizeof(STR_PROFILE_SLOT)];
+static uint32_t snapshotSize = 0;
+
+#ifdef PROFILER_SAMPLING
+// Open addressing hash table of sampled pcs
+static STR_PROFILE_SLOT slots[PROFILER_SLOTS];
+static int sampleAlarm = -1;
+static uint32_t samplePeriodMicros = 0;
+
+static void RAM_FUNC(recordSample)(uint32_t pc) {
+  samples = samples + 1;
+  tasks[currentTask].samples++;
+  const uint32_t hash = ((pc >> 1) * 2654435761u) >> (32 - PROFILER_SLOT_BITS);
+  for (uint32_t i = 0; i < PROFILER_PROBES; i++) {
+    STR_PROFILE_SLOT& slot = slots[(hash + i) % PROFILER_SLOTS];
+    if (slot.count == 0) slot.pc = pc;
+    if (slot.pc == pc) {
+      slot.count++;
+      return;
+    }
+  }
+  droppedSamples = droppedSamples + 1;
+}
+
+// frame is the exception frame of the interrupted code, frame[6] its pc
+extern "C" void RAM_FUNC(profilerSample)(const uint32_t* frame) {
+  timer_hw->intr = 1u << sampleAlarm;
+  timer_hw->alarm[sampleAlarm] = timer_hw->timerawl + samplePeriodMicros;
+  recordSample(frame[6]);
+}
+
+// Timer interrupt entry. Finds the exception frame on the stack the
+// interrupted code was using, and tail calls profilerSample with it.
+extern "C" void __attribute__((naked)) profilerIrq() {
+  __asm volatile(
+    "movs r0, #4\n"
+    "mov r1, lr\n"
+    "tst r0, r1\n"  // EXC_RETURN bit 2: 0 = main stack, 1 = process stack
+    "beq 1f\n"
+    "mrs r0, psp\n"
+    "b 2f\n"
+    "1: mrs r0, msp\n"
+    "2: ldr r1, =profilerSample\n"
+    "bx r1\n"
+    ".ltorg\n");
+}
+
+static void stopSampling() {
+  if (sampleAlarm < 0) return;
+  irq_set_enabled(TIMER_IRQ_0 + sampleAlarm, false);
+  hw_clear_bits(&timer_hw->inte, 1u << sampleAlarm);
+  timer_hw->armed = 1u << sampleAlarm;  // Disarm
+  timer_hw->intr = 1u << sampleAlarm;
+}
+
+// Sample on the calling core, core 0
+static void startSampling() {
+  if (sampleAlarm < 0) {
+    sampleAlarm = hardware_alarm_claim_unused(false);
+    if (sampleAlarm < 0) return;
+    irq_set_exclusive_handler(TIMER_IRQ_0 + sampleAlarm, profilerIrq);
+    irq_set_priority(TIMER_IRQ_0 + sampleAlarm, PROFILER_IRQ_PRIORITY);
+  }
+  samplePeriodMicros = 1000000 / sampleHz;
+  hw_set_bits(&timer_hw->inte, 1u << sampleAlarm);
+  timer_hw->alarm[sampleAlarm] = timer_hw->timerawl + samplePeriodMicros;
+  irq_set_enabled(TIMER_IRQ_0 + sampleAlarm, true);
+}
+#endif  // PROFILER_SAMPLING
+
+void setupProfiler(const char* const names[], uint8_t count) {
+  taskNames = names;
+  taskCount = min(count, static_cast<uint8_t>(PROFILER_MAX_TASKS - 1));
+  profileStartMillis = millis();
+  windowStartMicros = micros();
+  cpuLoad.minIdlePermille = 1000;
+}
+
+void startProfiler(uint16_t hz) {
+  sampleHz = min(hz, static_cast<uint16_t>(PROFILER_MAX_HZ));
+#ifdef PROFILER_SAMPLING
+  stopSampling();
+  memset(slots, 0, sizeof(slots));
+#else
+  sampleHz = 0;  // Load and task times only
+#endif
+  memset(tasks, 0, sizeof(tasks));
+  samples = 0;
+  droppedSamples = 0;
+  cpuLoad.peakBusyPermille[0] = 0;
+  cpuLoad.peakBusyPermille[1] = 0;
+  cpuLoad.minIdlePermille = 1000;
+  profileStartMillis = millis();
+#ifdef PROFILER_SAMPLING
+  if (sampleHz > 0) startSampling();
+#endif
+}
+
+void RAM_FUNC(profilerTaskBegin)(uint8_t task) {
+  taskStartMicros = micros();
+  currentTask = task < PROFILER_MAX_TASKS ? task : PROFILER_TASK_LOOP;
+}
+
+void RAM_FUNC(profilerTaskEnd)() {
+  const uint32_t elapsed = micros() - taskStartMicros;
+  PROFILER_TASK& task = tasks[currentTask];
+  currentTask = PROFILER_TASK_LOOP;
+  task.runs++;
+  task.busyMicros += elapsed;
+  busyMicros[0] = busyMicros[0] + elapsed;
+}
+
+void recordCpuBusy(uint8_t core, uint32_t micros) {
+  if (core < 2) busyMicros[core] = busyMicros[core] + micros;
+}
+
+void recordCpuIdle(uint32_t micros) {
+  idleMicros += micros;
+}
+
+void updateCpuLoad() {
+  const uint32_t nowMicros = micros();
+  const uint32_t elapsed = nowMicros - windowStartMicros;
+  if (elapsed < LOAD_WINDOW_MILLIS * 1000) return;
+  windowStartMicros = nowMicros;
+  for (uint8_t core = 0; core < 2; core++) {
+    const uint32_t busy = busyMicros[core];
+    const uint32_t permille = min(static_cast<uint64_t>(busy - windowBusyMicros[core]) * 1000 / elapsed,
+                                  static_cast<uint64_t>(1000));
+    windowBusyMicros[core] = busy;
+    cpuLoad.busyPermille[core] = permille;
+    if (permille > cpuLoad.peakBusyPermille[core]) cpuLoad.peakBusyPermille[core] = permille;
+  }
+  cpuLoad.idlePermille = min(static_cast<uint64_t>(idleMicros - windowIdleMicros) * 1000 / elapsed,
+                             static_cast<uint64_t>(1000));
+  windowIdleMicros = idleMicros;
+  if (cpuLoad.idlePermille < cpuLoad.minIdlePermille) cpuLoad.minIdlePermille = cpuLoad.idlePermille;
+}
+
+const STR_CPU_LOAD& getCpuLoad() {
+  return cpuLoad;
+}
+
+static void takeSnapshot() {
+  STR_PROFILE_HEADER header = {};
+  header.magic = PROFILE_MAGIC;
+  header.version = PROFILE_VERSION;
+  header.version_major = VERSION_MAJOR;
+  header.version_minor = VERSION_MINOR;
+  header.taskCount = taskCount + 1;
+  header.sampleHz = sampleHz;
+  header.samples = samples;
+  header.droppedSamples = droppedSamples;
+  header.durationMillis = millis() - profileStartMillis;
+  header.load = cpuLoad;
+  uint32_t pos = sizeof(header);
+
+  for (uint8_t i = 0; i < header.taskCount; i++) {
+    STR_PROFILE_TASK task = {};
+    const char* name = i == PROFILER_TASK_LOOP ? "loop" : taskNames[i - 1];
+    strncpy(task.name, name, sizeof(task.name));
+    task.samples = tasks[i].samples;
+    task.runs = tasks[i].runs;
+    task.busyMillis = tasks[i].busyMicros / 1000;
+    memcpy(snapshot + pos, &task, sizeof(task));
+    pos += sizeof(task);
+  }
+
+#ifdef PROFILER_SAMPLING
+  // Copy the used slots, sorted by pc, so the host can look up ranges
+  STR_PROFILE_SLOT* sorted = reinterpret_cast<STR_PROFILE_SLOT*>(snapshot + pos);
+  for (uint32_t i = 0; i < PROFILER_SLOTS; i++) {
+    const STR_PROFILE_SLOT slot = slots[i];  // May change under us, copy it once
+    if (slot.count == 0) continue;
+    uint32_t j = header.slotCount++;
+    for (; j > 0 && sorted[j - 1].pc > slot.pc; j--) sorted[j] = sorted[j - 1];
+    sorted[j] = slot;
+  }
+  pos += header.slotCount * sizeof(STR_PROFILE_SLOT);
+#endif
+
+  memcpy(snapshot, &header, sizeof(header));
+  snapshotSize = pos;
+}
+
+int32_t readProfile(uint32_t offset, uint8_t* buf, uint32_t len) {
+  if (offset == 0) takeSnapshot();
+  if (offset >= snapshotSize) return 0;
+  const uint32_t n = min(len, snapshotSize - offset);
+  memcpy(buf, snapshot + offset, n);
+  return n;
+}
+
+uint32_t getProfileSize() {
+  return snapshotSize;
+}
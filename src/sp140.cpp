@@ -1,11 +1,22 @@
 #include "sp140/config.h"
 #include "sp140/structs.h"
 
+#include "sp140/alloc_tracker.h"
 #include "sp140/altimeter.h"
+#include "sp140/battery.h"
+#include "sp140/benchmark.h"
 #include "sp140/buzzer.h"
+#include "sp140/clock.h"
 #include "sp140/device_data.h"
 #include "sp140/display.h"
 #include "sp140/esc_telemetry.h"
+#include "sp140/flight_log.h"
+#include "sp140/history.h"
+#include "sp140/idle.h"
+#include "sp140/i2c_bus.h"
+#include "sp140/profiler.h"
+#include "sp140/supervisor.h"
+#include "sp140/throttle_limit.h"
 #include "sp140/vibrate.h"
 #include "sp140/watchdog.h"
 #include "sp140/web_usb.h"
@@ -24,11 +35,20 @@ using ace_button::ButtonConfig;
 AceButton button(BUTTON_TOP);
 ResponsiveAnalogRead throttlePot(THROTTLE_PIN, false);
 CircularBuffer<int, 8> throttlePotBuffer;
-Servo escControl;
+Servo escControls[ESC_COUNT];
+static const uint8_t kEscPins[] = ESC_PINS;
+static const int16_t kEscTrims[] = ESC_TRIMS;
+static const STR_ESC_TELEMETRY_140* escTelemetry[ESC_COUNT];  // Of each ESC, for the limiter
 
-#define ESC_DISARMED_PWM      1010
-#define ESC_MIN_PWM           1030  // ESC min is 1050
-#define ESC_MAX_PWM           1990  // ESC max 1950
+// Longest time a critical thread may go without running. Armed, nothing erases
+// flash and the slowest pass is a display render plus a staging page program.
+// Disarmed, one pass may also erase a flash sector (journal, flight copy) or
+// run LittleFS, tens of ms. Well above both, well below a noticeable stall.
+#define THROTTLE_DEADLINE     250  // ms, runs every 22 ms
+#define ESC_DEADLINE          250  // ms, runs every 15 ms
+#define BUTTON_DEADLINE       250  // ms, runs every 5 ms
+
+#define IDLE_MAX_MILLIS       10   // Longest idle sleep, the fastest task runs every 5 ms
 
 Thread ledBlinkThread = Thread();
 Thread displayThread = Thread();
@@ -36,19 +56,43 @@ Thread throttleThread = Thread();
 Thread buttonThread = Thread();
 Thread escTelemetryThread = Thread();
 Thread webUsbThread = Thread();
-StaticThreadController<6> threads(&ledBlinkThread, &displayThread, &throttleThread,
-                                  &buttonThread, &escTelemetryThread, &webUsbThread);
+Thread deviceDataThread = Thread();
+Thread flightLogThread = Thread();
+#ifdef RP_PIO
+// I2C jobs run in loop1 on core1
+StaticThreadController<8> threads(&ledBlinkThread, &displayThread, &throttleThread,
+                                  &buttonThread, &escTelemetryThread, &webUsbThread,
+                                  &deviceDataThread, &flightLogThread);
+// Profiler names of the threads, in the same order. Task n is thread n - 1.
+static const char* const kTaskNames[] = {"led", "display", "throttle", "button", "esc",
+                                         "webusb", "devicedata", "flightlog"};
+#else
+Thread i2cBusThread = Thread();
+StaticThreadController<9> threads(&ledBlinkThread, &displayThread, &throttleThread,
+                                  &buttonThread, &escTelemetryThread, &webUsbThread,
+                                  &deviceDataThread, &flightLogThread, &i2cBusThread);
+static const char* const kTaskNames[] = {"led", "display", "throttle", "button", "esc",
+                                         "webusb", "devicedata", "flightlog", "i2c"};
+#endif
+
+// Worst-case throttle loop timing, reset on arm and reported on disarm
+STR_LOOP_TIMING throttleTiming;
 
 bool armed = false;
-bool cruising = false;
+volatile bool cruising = false;
+// Motor cut after a missed deadline, until the throttle is released. Set by
+// the supervisor's timer interrupt, like cruising and lastThrottlePWM.
+volatile bool throttleFailsafe = false;
 unsigned int armedStartMillis = 0;
+volatile int lastThrottlePWM = ESC_DISARMED_PWM;
+float lastAltitude = __FLT_MIN__;
 static STR_DEVICE_DATA_140_V1 deviceData;
 
 //
 // Misc utilities
 //
 
-int getAvgPot() {
+int RAM_FUNC(getAvgPot)() {
   int avgPot = 0;
   for (decltype(throttlePotBuffer)::index_t i = 0; i < throttlePotBuffer.size(); ++i) {
     avgPot += throttlePotBuffer[i];
@@ -58,14 +102,69 @@ int getAvgPot() {
 }
 
 // Returns true if the throttlePot is above the safe threshold
-bool getThrottleActive() {
+bool RAM_FUNC(getThrottleActive)() {
   return throttlePot.getValue() > POT_SAFE_LEVEL;
 }
 
+void RAM_FUNC(recordLoopTiming)(STR_LOOP_TIMING* timing, uint32_t startMicros) {
+  const uint32_t runMicros = micros() - startMicros;
+  if (timing->runs > 0) {
+    const uint32_t intervalMicros = startMicros - timing->lastStartMicros;
+    if (intervalMicros > timing->maxIntervalMicros) timing->maxIntervalMicros = intervalMicros;
+  }
+  if (runMicros > timing->maxRunMicros) timing->maxRunMicros = runMicros;
+  timing->lastStartMicros = startMicros;
+  timing->runs++;
+}
+
+void logFlightData(const STR_ESC_TELEMETRY_140& telemetry, bool escStale) {
+  STR_FLIGHT_RECORD_140 record;
+  record.millis = millis();
+  record.throttlePWM = lastThrottlePWM;
+  record.centiVolts = telemetry.centiVolts;
+  record.deciCelsius = telemetry.deciCelsius;
+  record.centiAmps = telemetry.centiAmps;
+  record.watts = telemetry.watts;
+  record.milliwattHours = telemetry.milliwattHours;
+  record.rpm = telemetry.rpm;
+  record.inPWM = telemetry.inPWM;
+  record.outPWM = telemetry.outPWM;
+  record.statusFlag = telemetry.statusFlag;
+  record.altitude = lastAltitude;
+  record.stateFlags = 0;
+  if (armed) record.stateFlags |= FLIGHT_FLAG_ARMED;
+  if (cruising) record.stateFlags |= FLIGHT_FLAG_CRUISING;
+  if (getThrottleActive()) record.stateFlags |= FLIGHT_FLAG_THROTTLE_ACTIVE;
+  if (escStale) record.stateFlags |= FLIGHT_FLAG_ESC_STALE;
+  if (throttleFailsafe) record.stateFlags |= FLIGHT_FLAG_FAILSAFE;
+  if (getThrottleLimit().active) record.stateFlags |= FLIGHT_FLAG_LIMITED;
+  logFlightRecord(record);
+  queueLiveTelemetry(record);
+}
+
 void setLEDs(byte state) {
   digitalWrite(LED_SW, state);
 }
 
+// Send the throttle pulse to every ESC. A running motor gets its trim.
+void RAM_FUNC(writeEscPulse)(int pwm) {
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    const int trimmed = pwm > ESC_DISARMED_PWM ? constrain(pwm + kEscTrims[i], ESC_MIN_PWM, ESC_MAX_PWM) : pwm;
+    escControls[i].writeMicroseconds(trimmed);
+  }
+}
+
+// Change the CPU clock. The ESC pulse comes from a PIO clocked by the CPU,
+// so it is set up again with the same pulse width.
+void setCpuClock(uint8_t profile) {
+  if (!setClockProfile(profile)) return;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    escControls[i].detach();
+    escControls[i].attach(kEscPins[i]);
+  }
+  writeEscPulse(lastThrottlePWM);
+}
+
 // Event handler for button presses
 void handleButtonEvent(AceButton* /* btn */, uint8_t eventType, uint8_t /* st */) {
   const bool doubleClick = eventType == AceButton::kEventDoubleClicked;
@@ -77,10 +176,22 @@ void handleButtonEvent(AceButton* /* btn */, uint8_t eventType, uint8_t /* st */
     armed = false;
     cruising = false;
 
+    stopFlightLog();
+    setCpuClock(CLOCK_IDLE);
     ledBlinkThread.enabled = true;
     vibrateSequence(100);
     buzzerSequence(2093, 1976, 880);
 
+#ifdef LOOP_TIMING
+    Serial.printf("throttle loop: %u runs, max run %u us, max interval %u us\n",
+                  static_cast<unsigned int>(throttleTiming.runs),
+                  static_cast<unsigned int>(throttleTiming.maxRunMicros),
+                  static_cast<unsigned int>(throttleTiming.maxIntervalMicros));
+#endif
+#ifdef ALLOC_TRACKER
+    printAllocSites(&Serial);
+#endif
+
     // Store the new total armed_minutes
     refreshDeviceData(&deviceData);
     const unsigned int armedMillis = millis() - armedStartMillis;
@@ -97,6 +208,12 @@ void handleButtonEvent(AceButton* /* btn */, uint8_t eventType, uint8_t /* st */
 
     // ARM
     throttlePotBuffer.clear();
+    throttleTiming = {};
+    startFlightLog();
+    resetHistory();
+    resetFlightTimeWindow();
+    resetThrottleLimit();
+    setCpuClock(CLOCK_ARMED);  // Before the throttle loop starts driving the ESC
     armed = true;
     armedStartMillis = currentMillis;
 
@@ -137,16 +254,31 @@ void setupButton() {
 // Thread callbacks
 //
 
-void throttleThreadCallback() {
+void RAM_FUNC(updateThrottle)() {
   // We need to consistently call throttlePot.update().
   // This should be the only place it is called!
   throttlePot.update();
+  updateEscTelemetry();  // Never waits, and gives the limiter the newest packet
 
   if (!armed) {
-    escControl.writeMicroseconds(ESC_DISARMED_PWM);
+    throttleFailsafe = false;
+    lastThrottlePWM = ESC_DISARMED_PWM;
+    writeEscPulse(lastThrottlePWM);
     return;
   }
 
+  // After a fail-safe cut, only hand control back once the throttle is released,
+  // so the motor never jumps back to the stale setting.
+  if (throttleFailsafe) {
+    if (getThrottleActive()) {
+      lastThrottlePWM = ESC_DISARMED_PWM;
+      writeEscPulse(lastThrottlePWM);
+      return;
+    }
+    throttleFailsafe = false;
+    throttlePotBuffer.clear();
+  }
+
   static unsigned int cruiseStartMillis = 0;
   if (cruising) {
     if (cruiseStartMillis == 0) cruiseStartMillis = millis();
@@ -162,25 +294,68 @@ void throttleThreadCallback() {
   }
   const int avgPot = getAvgPot();
   const int maxPWM = (deviceData.performance_mode == 0) ? 1850 : ESC_MAX_PWM;
-  const int throttlePWM = map(avgPot, 0, 4095, ESC_MIN_PWM, maxPWM);
-  escControl.writeMicroseconds(throttlePWM);
+  const int pwm = limitThrottle(map(avgPot, 0, 4095, ESC_MIN_PWM, maxPWM), escTelemetry);
+  noInterrupts();  // Unless the fail-safe cut the motor while this run was late
+  if (!throttleFailsafe) {
+    lastThrottlePWM = pwm;
+    writeEscPulse(pwm);
+  }
+  interrupts();
+}
+
+void RAM_FUNC(throttleThreadCallback)() {
+  const uint32_t startMicros = micros();
+  updateThrottle();
+  recordLoopTiming(&throttleTiming, startMicros);
+  taskHeartbeat(SUPERVISED_THROTTLE);
+}
+
+// The throttle thread missed its deadline: cut the motor now, rather than
+// leave the ESC at a setting nobody is updating. In the supervisor's timer
+// interrupt, while the main loop may still be stuck.
+void RAM_FUNC(throttleFailsafeCallback)() {
+  throttleFailsafe = true;
+  cruising = false;
+  lastThrottlePWM = ESC_DISARMED_PWM;
+  writeEscPulse(lastThrottlePWM);
+}
+
+// Then tell the pilot, once the main loop runs again
+void throttleAlarmCallback() {
+  if (!armed) return;
+  vibrateNotify();
+  buzzerSequence(1000, 500, 1000);
 }
 
-void escTelemetryThreadCallback() {
+void RAM_FUNC(escTelemetryThreadCallback)() {
   updateEscTelemetry();
-  static unsigned int lastEscStaleWarningMillis = 0;
+  taskHeartbeat(SUPERVISED_ESC);
+  const STR_ESC_TELEMETRY_140& telemetry = getEscTelemetry();
+  static unsigned int lastLoggedUpdateMillis = 0;
+  if (telemetry.lastUpdateMillis != lastLoggedUpdateMillis) {  // Log every fresh packet
+    lastLoggedUpdateMillis = telemetry.lastUpdateMillis;
+    logFlightData(telemetry, false);
+    updateFlightTime(telemetry, deviceData.batt_size);
+    addHistorySample(HISTORY_POWER, telemetry.watts);
+    addHistorySample(HISTORY_VOLTS, telemetry.centiVolts);
+    addHistorySample(HISTORY_TEMPERATURE, telemetry.deciCelsius);
+  }
+  // Alert every 2 seconds for each ESC with no fresh telemetry
+  static unsigned int lastEscStaleWarningMillis[ESC_COUNT] = {};
   const unsigned int nowMillis = millis();
-  if (nowMillis - getEscTelemetry().lastUpdateMillis > 2000) {  // Alert if no fresh ESC telemetry
-      if (nowMillis - lastEscStaleWarningMillis > 2000) {       // Alert every 2 seconds
-        lastEscStaleWarningMillis = nowMillis;
-        vibrateNotify();
-        buzzerSequence(1000, 1000);
-      }
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if (nowMillis - getEscTelemetry(i).lastUpdateMillis <= ESC_STALE_MILLIS) continue;
+    if (nowMillis - lastEscStaleWarningMillis[i] <= 2000) continue;
+    lastEscStaleWarningMillis[i] = nowMillis;
+    logFlightData(telemetry, true);
+    vibrateNotify();
+    buzzerSequence(1000, 1000);
   }
 }
 
 void buttonThreadCallback() {
   button.check();
+  taskHeartbeat(SUPERVISED_BUTTON);
 }
 
 void ledBlinkThreadCallback() {
@@ -188,9 +363,11 @@ void ledBlinkThreadCallback() {
 }
 
 void displayThreadCallback() {
-  const float altitude = getAltitude(deviceData);
+  lastAltitude = getAltitude(deviceData);
+  if (lastAltitude != __FLT_MIN__) addHistorySample(HISTORY_ALTITUDE, lroundf(lastAltitude));
+  updateHistory();
   updateDisplay(
-    deviceData, getEscTelemetry(), altitude, armed, cruising, armedStartMillis);
+    deviceData, getEscTelemetry(), lastAltitude, armed, cruising, armedStartMillis);
 }
 
 void webUsbLineStateCallback(bool connected) {
@@ -200,20 +377,52 @@ void webUsbLineStateCallback(bool connected) {
 }
 
 void webUsbThreadCallback() {
+  if (armed) {
+    stopWebUsbDownload();
+  } else {
+    serviceWebUsbDownload();
+  }
+  serviceWebUsbLive();  // Also while armed, for bench tests
   if (!armed && parseWebUsbSerial(&deviceData)) {
     buzzerSequence(300, 300, 900);
     writeDeviceData(&deviceData);
     resetRotation(deviceData.screen_rotation);  // Screen orientation may have changed
     sendWebUsbSerial(deviceData);
   }
+  serviceWebUsbTx();
+  // Run often while there is data to send, to keep the USB endpoint busy
+  const bool sending = webUsbDownloadActive() || getWebUsbTxStats().depth > 0;
+  webUsbThread.setInterval(sending ? 1 : webUsbLiveActive() ? 10 : 50);
+}
+
+// Commit device data in the background. A commit can stall for a flash erase,
+// so never do it while armed, on throttle, or when the throttle thread is due.
+void deviceDataThreadCallback() {
+  if (armed || getThrottleActive() || throttleThread.shouldRun()) return;
+  serviceDeviceData();
 }
 
+// Move recorded flight data to flash in page-sized steps between throttle runs.
+void flightLogThreadCallback() {
+  if (throttleThread.shouldRun()) return;
+  serviceFlightLog();
+}
+
+#ifndef RP_PIO
+// Run queued altimeter and haptic transfers between throttle runs.
+void i2cBusThreadCallback() {
+  if (throttleThread.shouldRun()) return;
+  serviceI2cBus();
+}
+#endif
+
 //
 // Arduino setup/main functions
 //
 
 // The setup function runs once when you press reset or power the board.
 void setup() {
+  setupClock();  // Before any peripheral is set up
   Serial.begin(115200);  // For debug
 
   // Set up the throttle
@@ -221,15 +430,22 @@ void setup() {
   throttlePot.setAnalogResolution(4096);
 
   // Set up the esc control
-  escControl.attach(ESC_PIN);
-  escControl.writeMicroseconds(ESC_DISARMED_PWM);
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    escControls[i].attach(kEscPins[i]);
+  }
+  writeEscPulse(ESC_DISARMED_PWM);
 
   pinMode(LED_SW, OUTPUT);  // Set up the LED
   setupButton();
   setupBuzzer();
   setupEscTelemetry();
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    escTelemetry[i] = &getEscTelemetry(i);
+  }
   setupDeviceData();
   refreshDeviceData(&deviceData);
+  setupFlightLog();
+  resetHistory();
   setupAltimeter();
   setupVibrate();
   setupWebUsbSerial(webUsbLineStateCallback);
@@ -255,27 +471,76 @@ void setup() {
 
   webUsbThread.onRun(webUsbThreadCallback);
   webUsbThread.setInterval(50);
+
+  deviceDataThread.onRun(deviceDataThreadCallback);
+  deviceDataThread.setInterval(100);
+
+  flightLogThread.onRun(flightLogThreadCallback);
+  flightLogThread.setInterval(10);
+
+#ifndef RP_PIO
+  i2cBusThread.onRun(i2cBusThreadCallback);
+  i2cBusThread.setInterval(5);
+#endif
+
+  setupProfiler(kTaskNames, threads.size());
+  setupIdle();
+
+  // A late throttle cuts the motor. Late telemetry or buttons are only logged,
+  // the throttle keeps working without them.
+  superviseTask(SUPERVISED_THROTTLE, "throttle", THROTTLE_DEADLINE, throttleFailsafeCallback, throttleAlarmCallback);
+  superviseTask(SUPERVISED_ESC, "esc", ESC_DEADLINE, nullptr, nullptr);
+  superviseTask(SUPERVISED_BUTTON, "button", BUTTON_DEADLINE, nullptr, nullptr);
+
+#ifdef BENCHMARK
+  runBenchmarks(&Serial);
+#endif
+#ifdef ALLOC_TRACKER
+  lockAllocations();  // No heap allocation from here on
+#endif
+  setCpuClock(CLOCK_IDLE);  // After the benchmarks, they count cycles at F_CPU
+  startI2cBus();  // setup() runs alongside loop1, so only once it is done with the bus
+  startSupervisor();
 }
 
-// Main loop
+// The millisecond the next thread is due, at most IDLE_MAX_MILLIS ahead.
+// A Thread only tells whether it is due at a given time, so probe ahead.
+uint32_t nextThreadMillis() {
+  const uint32_t now = millis();
+  for (uint32_t ahead = 0; ahead < IDLE_MAX_MILLIS; ahead++) {
+    for (int i = 0; i < threads.size(); i++) {
+      if (threads.get(i)->shouldRun(now + ahead)) return now + ahead;
+    }
+  }
+  return now + IDLE_MAX_MILLIS;
+}
+
+// Main loop. Runs the due threads like threads.run(), and tells the
+// profiler which one is running. Then sleeps until the next one is due.
 void loop() {
-  resetWatchdog();
-  threads.run();
+  // The hardware watchdog catches hangs, the supervisor catches starved tasks
+  if (checkTaskDeadlines()) resetWatchdog();
+  for (int i = 0; i < threads.size(); i++) {
+    Thread* thread = threads.get(i);
+    if (!thread->shouldRun()) continue;
+    profilerTaskBegin(i + 1);
+    thread->run();
+    profilerTaskEnd();
+  }
+  updateCpuLoad();
+  idleUntil(nextThreadMillis());
 }
 
 #ifdef RP_PIO
 // Set up the second core. Nothing to do for now.
 void setup1() {}
 
-// Main loop on the second core of the RP2040
-// Play notes using delay, which doesn't block the first core.
+// Main loop on the second core of the RP2040. Plays notes and runs the I2C
+// jobs, which would hold up the throttle loop on the first core.
 void loop1() {
-  if (rp2040.fifo.available() > 0) {
-    STR_NOTE note;
-    note.data = rp2040.fifo.pop();
-    tone(BUZZER_PIN, note.f.freq);
-    delay(note.f.duration);
-    noTone(BUZZER_PIN);
-  }
+  const uint32_t startMicros = micros();
+  const bool played = playBuzzerNotes();
+  const bool ranJob = serviceI2cBus();
+  if (played || ranJob) recordCpuBusy(1, micros() - startMicros);
 }
 #endif
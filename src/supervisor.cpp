@@ -0,0 +1,167 @@
+#include "sp140/supervisor.h"
+
+#include "sp140/config.h"
+
+#include <Arduino.h>
+
+#ifdef RP_PIO
+  #include <hardware/irq.h>
+  #include <hardware/structs/timer.h>
+  #include <hardware/timer.h>
+
+  #define SUPERVISOR_IRQ_PRIORITY  0x40  // Above the default, so a busy handler can't hold it off
+#endif
+
+#define SUPERVISOR_TICK_MICROS  10000  // How often the timer interrupt checks the deadlines
+
+typedef struct {
+  const char* name;
+  uint16_t deadlineMillis;  // 0 = not supervised
+  void (*failsafe)();
+  void (*alarm)();
+  volatile uint32_t lastBeatMillis;
+  volatile uint32_t missedGapMillis;  // gap when the interrupt found an overrun, to be logged
+  uint32_t lateGapMillis;   // gap of an overrun that ended, to be logged
+  volatile bool late;
+} SUPERVISED_TASK;
+
+static SUPERVISED_TASK tasks[SUPERVISED_TASKS];
+static STR_TASK_DEADLINE_STATS taskStats[SUPERVISED_TASKS];
+static bool started = false;
+static bool ticking = false;  // The timer interrupt is running
+
+void superviseTask(uint8_t task, const char* name, uint16_t deadlineMillis, void (*failsafe)(),
+                   void (*alarm)()) {
+  if (task >= SUPERVISED_TASKS) return;
+  tasks[task].name = name;
+  tasks[task].deadlineMillis = deadlineMillis;
+  tasks[task].failsafe = failsafe;
+  tasks[task].alarm = alarm;
+}
+
+// Runs in the timer interrupt, so it works while the main loop is stuck.
+// Only runs the fail-safes, checkTaskDeadlines() logs.
+static void RAM_FUNC(checkOverruns)() {
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < SUPERVISED_TASKS; i++) {
+    SUPERVISED_TASK& t = tasks[i];
+    if (t.deadlineMillis == 0 || t.late) continue;
+    const uint32_t sinceBeat = now - t.lastBeatMillis;
+    if (sinceBeat <= t.deadlineMillis) continue;
+
+    t.late = true;
+    taskStats[i].overruns++;
+    taskStats[i].lastOverrunMillis = now;
+    if (t.failsafe) t.failsafe();
+    t.missedGapMillis = sinceBeat;
+  }
+}
+
+#ifdef RP_PIO
+static int tickAlarm = -1;
+
+static void RAM_FUNC(supervisorIrq)() {
+  timer_hw->intr = 1u << tickAlarm;
+  timer_hw->alarm[tickAlarm] = timer_hw->timerawl + SUPERVISOR_TICK_MICROS;
+  checkOverruns();
+}
+
+// On the calling core, core 0, the one running the supervised tasks
+static void startTickTimer() {
+  tickAlarm = hardware_alarm_claim_unused(false);
+  if (tickAlarm < 0) return;  // checkTaskDeadlines() checks instead
+  irq_set_exclusive_handler(TIMER_IRQ_0 + tickAlarm, supervisorIrq);
+  irq_set_priority(TIMER_IRQ_0 + tickAlarm, SUPERVISOR_IRQ_PRIORITY);
+  hw_set_bits(&timer_hw->inte, 1u << tickAlarm);
+  timer_hw->alarm[tickAlarm] = timer_hw->timerawl + SUPERVISOR_TICK_MICROS;
+  irq_set_enabled(TIMER_IRQ_0 + tickAlarm, true);
+  ticking = true;
+}
+#elif M0_PIO
+// TCC2 (TC3 is the buzzer, TC4 the servo, TC5 tone) overflows every tick.
+// It shares its clock with TC3, GCLK0.
+static void syncTickTimer() {
+  while (TCC2->SYNCBUSY.reg) {}
+}
+
+void TCC2_Handler() {
+  TCC2->INTFLAG.reg = TCC_INTFLAG_OVF;
+  checkOverruns();
+}
+
+static void startTickTimer() {
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+  while (GCLK->STATUS.bit.SYNCBUSY) {}
+  TCC2->CTRLA.reg &= ~TCC_CTRLA_ENABLE;
+  syncTickTimer();
+  TCC2->CTRLA.reg = TCC_CTRLA_PRESCALER_DIV1024;
+  TCC2->WAVE.reg = TCC_WAVE_WAVEGEN_NFRQ;
+  syncTickTimer();
+  TCC2->PER.reg = F_CPU / 1024 / (1000000 / SUPERVISOR_TICK_MICROS) - 1;
+  syncTickTimer();
+  TCC2->INTENSET.reg = TCC_INTENSET_OVF;
+  NVIC_SetPriority(TCC2_IRQn, 1);  // Below the servo timer it writes to, above the buzzer
+  NVIC_EnableIRQ(TCC2_IRQn);
+  TCC2->CTRLA.reg |= TCC_CTRLA_ENABLE;
+  syncTickTimer();
+  ticking = true;
+}
+#elif SIL_PIO
+static void startTickTimer() {
+  simTimerInterrupt(SUPERVISOR_TICK_MICROS, checkOverruns);
+  ticking = true;
+}
+#endif
+
+void startSupervisor() {
+  const uint32_t now = millis();
+  for (uint8_t i = 0; i < SUPERVISED_TASKS; i++) tasks[i].lastBeatMillis = now;
+  started = true;
+  startTickTimer();
+}
+
+// Called from the tasks themselves, so only record; checkTaskDeadlines() logs
+void RAM_FUNC(taskHeartbeat)(uint8_t task) {
+  SUPERVISED_TASK& t = tasks[task];
+  const uint32_t now = millis();
+  const uint32_t gap = now - t.lastBeatMillis;
+  t.lastBeatMillis = now;
+  if (!started) return;
+  if (gap > taskStats[task].worstGapMillis) taskStats[task].worstGapMillis = gap;
+  if (t.late) {
+    t.late = false;
+    t.lateGapMillis = gap;
+    taskStats[task].lastGapMillis = gap;
+  }
+}
+
+bool checkTaskDeadlines() {
+  if (!started) return true;
+  if (!ticking) checkOverruns();
+  const uint32_t now = millis();
+  bool onTime = true;
+  for (uint8_t i = 0; i < SUPERVISED_TASKS; i++) {
+    SUPERVISED_TASK& t = tasks[i];
+    if (t.deadlineMillis == 0) continue;
+    noInterrupts();
+    const uint32_t missedGap = t.missedGapMillis;
+    t.missedGapMillis = 0;
+    interrupts();
+    if (missedGap > 0) {
+      if (t.alarm) t.alarm();  // First, before taking time to log
+      Serial.printf("deadline: %s missed, %u ms since it ran (deadline %u ms), %u overruns\n", t.name,
+                    static_cast<unsigned int>(missedGap), t.deadlineMillis,
+                    static_cast<unsigned int>(taskStats[i].overruns));
+    }
+    if (t.lateGapMillis > 0) {
+      Serial.printf("deadline: %s ran again after %u ms\n", t.name, static_cast<unsigned int>(t.lateGapMillis));
+      t.lateGapMillis = 0;
+    }
+    if (now - t.lastBeatMillis > t.deadlineMillis) onTime = false;
+  }
+  return onTime;
+}
+
+const STR_TASK_DEADLINE_STATS& getTaskDeadlineStats(uint8_t task) {
+  return taskStats[task < SUPERVISED_TASKS ? task : 0];
+}
@@ -0,0 +1,105 @@
+#include "sp140/throttle_limit.h"
+
+#include "sp140/config.h"
+#include "sp140/esc_telemetry.h"
+
+#include <Arduino.h>
+
+#define PWM_RANGE              (ESC_MAX_PWM - ESC_MIN_PWM)
+#define NO_CAP                 1000
+#define HOLD_PERMILLE          950  // Between 95% and 100% of a limit, keep the cap
+#define RECOVER_PERMILLE_PER_S 500  // The cap rises through the whole range in 2 s
+
+static STR_THROTTLE_LIMIT throttleLimit = {NO_CAP, 0, LIMIT_WATTS};
+static uint32_t lastPacketMillis[ESC_COUNT];
+static uint32_t newPackets = 0;  // Bit per ESC: it sent a packet the cap hasn't seen yet
+static uint32_t lastCallMillis = 0;
+static uint16_t outputPermille = 0;  // Throttle sent at the last call
+static bool recovering = false;
+
+// The power limit, lowered linearly as the ESC heats up
+static int32_t RAM_FUNC(deratedWatts)(int16_t deciCelsius) {
+  if (deciCelsius <= LIMIT_DERATE_DECI_C) return LIMIT_WATTS;
+  if (deciCelsius >= LIMIT_MAX_DECI_C) return LIMIT_MIN_WATTS;
+  return LIMIT_WATTS - static_cast<int32_t>(LIMIT_WATTS - LIMIT_MIN_WATTS) * (deciCelsius - LIMIT_DERATE_DECI_C) /
+                       (LIMIT_MAX_DECI_C - LIMIT_DERATE_DECI_C);
+}
+
+// Move the cap for a round of fresh packets, one from each ESC in escs (a bit per ESC)
+static void RAM_FUNC(updateCap)(const STR_ESC_TELEMETRY_140* const telemetry[], uint32_t escs) {
+  // Load of the most loaded ESC against each limit, 1000 = at the limit
+  int32_t current = 0;
+  int32_t power = 0;
+  throttleLimit.wattLimit = LIMIT_WATTS;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if ((escs & (1u << i)) == 0) continue;
+    const int32_t wattLimit = deratedWatts(telemetry[i]->deciCelsius);
+    throttleLimit.wattLimit = min(throttleLimit.wattLimit, wattLimit);
+    current = max(current, telemetry[i]->centiAmps * 1000 / LIMIT_CENTIAMPS);
+    power = max(power, telemetry[i]->watts * 1000 / wattLimit);
+  }
+  const int32_t load = max(current, power);
+
+  if (load > 1000) {
+    // Current and power go with about the cube of the throttle. Scale the
+    // throttle by the cube root of limit / load, to first order (2 + limit / load) / 3.
+    const uint32_t throttle = min(outputPermille, throttleLimit.capPermille);
+    throttleLimit.capPermille = throttle * (2 * load + 1000) / (3 * load);
+    throttleLimit.active = current > 1000 ? LIMIT_CURRENT : LIMIT_POWER;
+    if (throttleLimit.wattLimit < LIMIT_WATTS) throttleLimit.active |= LIMIT_TEMPERATURE;
+  }
+  recovering = load < HOLD_PERMILLE;
+}
+
+void resetThrottleLimit() {
+  throttleLimit.capPermille = NO_CAP;
+  throttleLimit.active = 0;
+  throttleLimit.wattLimit = LIMIT_WATTS;
+  outputPermille = 0;
+  recovering = false;
+  newPackets = 0;
+  lastCallMillis = millis();
+}
+
+int RAM_FUNC(limitThrottle)(int pwm, const STR_ESC_TELEMETRY_140* const telemetry[]) {
+  const uint32_t nowMillis = millis();
+  uint32_t fresh = 0;  // Bit per ESC
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    const uint32_t packetMillis = telemetry[i]->lastUpdateMillis;
+    if (packetMillis == 0 || nowMillis - packetMillis > ESC_STALE_MILLIS) continue;
+    fresh |= 1u << i;
+    if (packetMillis != lastPacketMillis[i]) newPackets |= 1u << i;
+    lastPacketMillis[i] = packetMillis;
+  }
+  // Move the cap once every fresh ESC has reported, so packets of several
+  // ESCs showing the same overload only lower it once
+  newPackets &= fresh;
+  if (fresh != 0 && newPackets == fresh) {
+    updateCap(telemetry, fresh);
+    newPackets = 0;
+  }
+  const bool stale = fresh == 0;
+  // Without telemetry there is nothing to limit against, so let go
+  if ((recovering || stale) && throttleLimit.capPermille < NO_CAP) {
+    const uint32_t raise = RECOVER_PERMILLE_PER_S * (nowMillis - lastCallMillis) / 1000;
+    throttleLimit.capPermille = min(throttleLimit.capPermille + raise, static_cast<uint32_t>(NO_CAP));
+    if (throttleLimit.capPermille == NO_CAP) throttleLimit.active = 0;
+  }
+  lastCallMillis = nowMillis;
+
+  if (pwm <= ESC_MIN_PWM) {
+    outputPermille = 0;
+    return pwm;
+  }
+  const uint16_t request = min((pwm - ESC_MIN_PWM) * 1000 / PWM_RANGE, NO_CAP);
+  if (request <= throttleLimit.capPermille) {
+    outputPermille = request;
+    return pwm;
+  }
+  outputPermille = throttleLimit.capPermille;
+  return ESC_MIN_PWM + throttleLimit.capPermille * PWM_RANGE / 1000;
+}
+
+const STR_THROTTLE_LIMIT& getThrottleLimit() {
+  return throttleLimit;
+}
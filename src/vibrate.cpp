@@ -1,4 +1,5 @@
 #include "sp140/config.h"
+#include "sp140/i2c_bus.h"
 #include "sp140/vibrate.h"
 
 #include <Adafruit_DRV2605.h>    // haptic vibration controller
@@ -6,16 +7,35 @@
 Adafruit_DRV2605 vibe;
 bool vibePresent = false;
 
-void vibrateSequence(uint8_t vibe0, uint8_t vibe1, uint8_t vibe2) {
-  if (!vibePresent) return;
+// Waveforms to play, written to the DRV2605 by a job on the I2C bus (core1
+// on the RP2040). Packed in one word, so the job never sees half a sequence.
+// A new sequence posted before the job runs replaces the waiting one.
+static volatile uint32_t pendingWaveforms = 0;
+static volatile bool playPending = false;
+
+static void playWaveformsJob(void* /* context */) {
+  playPending = false;
+  __sync_synchronize();  // A sequence stored after this posts another job
+  const uint32_t waveforms = pendingWaveforms;
+  const uint8_t vibe1 = waveforms >> 8;
+  const uint8_t vibe2 = waveforms >> 16;
   int i = 0;
-  vibe.setWaveform(i, vibe0);
+  vibe.setWaveform(i, waveforms & 0xFF);
   if (vibe1 != 0) vibe.setWaveform(++i, vibe1);
   if (vibe2 != 0) vibe.setWaveform(++i, vibe2);
   vibe.setWaveform(++i, 0);
   vibe.go();
 }
 
+void vibrateSequence(uint8_t vibe0, uint8_t vibe1, uint8_t vibe2) {
+  if (!vibePresent) return;
+  pendingWaveforms = vibe0 | vibe1 << 8 | static_cast<uint32_t>(vibe2) << 16;
+  __sync_synchronize();  // Store the sequence before checking for a waiting job
+  if (playPending) return;
+  playPending = true;  // Before posting, the job may run on the other core right away
+  if (!postI2cJob(playWaveformsJob)) playPending = false;
+}
+
 void vibrateNotify() {
   vibrateSequence(15);
 }
@@ -1,3 +1,4 @@
+#include "sp140/config.h"
 #include "sp140/watchdog.h"
 
 // Hardware-specific libraries
@@ -15,7 +16,7 @@ void setupWatchdog() {
   #endif
 }
 
-void resetWatchdog() {
+void RAM_FUNC(resetWatchdog)() {
   #ifdef M0_PIO
     Watchdog.reset();
   #elif RP_PIO
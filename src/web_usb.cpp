@@ -1,6 +1,12 @@
 #include <cstdio>
 
+#include "sp140/battery.h"
+#include "sp140/cobs.h"
 #include "sp140/config.h"
+#include "sp140/device_data.h"
+#include "sp140/flight_log.h"
+#include "sp140/log_codec.h"
+#include "sp140/profiler.h"
 #include "sp140/web_usb.h"
 
 #include <Arduino.h>
@@ -10,6 +16,37 @@
 Adafruit_USBD_WebUSB usb_web;
 WEBUSB_URL_DEF(landingPage, 1 /*https*/, "config.openppg.com");
 
+#define DOWNLOAD_CHUNK_MAX      256   // data bytes per chunk
+#define DOWNLOAD_CHUNK_MIN      16    // wait for at least this much queue space
+#define DOWNLOAD_BUDGET_MICROS  5000  // most time spent reading per service call
+#define DOWNLOAD_OVERHEAD       (sizeof(STR_DOWNLOAD_CHUNK_HEADER) + 2)
+
+#define CONFIG_FRAME_OVERHEAD   4  // type, seq, crc16
+#define CONFIG_FRAME_MAX        (CONFIG_FRAME_OVERHEAD + sizeof(STR_CONFIG_MSG_140))
+
+#define LIVE_PAYLOAD_MAX        48  // bytes of encoded samples per packet
+#define LIVE_FRAME_MAX          (COBS_MAX_ENCODED_SIZE(CONFIG_FRAME_OVERHEAD + LIVE_PAYLOAD_MAX) + 2)
+#define LIVE_LATENCY_MILLIS     50  // send a partial packet after this long
+#define LIVE_FLIGHT_TIME_MILLIS 1000  // send the flight time estimate this often, it changes once a second
+
+#ifdef RP_PIO
+  #define USB_TX_QUEUE_SIZE     2048  // Power of 2. A download chunk plus a few messages.
+#else
+  #define USB_TX_QUEUE_SIZE     512
+#endif
+
+// Everything sent over WebUSB goes through this queue, and is moved to the
+// endpoint FIFO only as space becomes available. usb_web.write() spins until
+// everything is written, which hangs when a message is larger than the FIFO.
+static uint8_t txQueue[USB_TX_QUEUE_SIZE];
+static uint32_t txHead = 0;  // free-running, wrap with % USB_TX_QUEUE_SIZE
+static uint32_t txTail = 0;
+static STR_USB_TX_STATS txStats;
+
+static bool downloading = false;
+static uint32_t downloadFlight = 0;
+static uint32_t downloadOffset = 0;
+
 // Hardware-specific libraries
 #ifdef RP_PIO
   #include "pico/unique_id.h"
@@ -21,9 +58,53 @@ WEBUSB_URL_DEF(landingPage, 1 /*https*/, "config.openppg.com");
   #define DBL_TAP_MAGIC_QUICK_BOOT 0xf02669ef
 #endif
 
-// Get chip serial number
-String chipId() {
-  String id = "unknown";
+static uint32_t txFree() {
+  return USB_TX_QUEUE_SIZE - (txHead - txTail);
+}
+
+// Queue a whole message, or drop all of it if it doesn't fit. Never blocks.
+static bool queueTx(const uint8_t* data, uint32_t len) {
+  if (!usb_web.connected()) return false;
+  if (len > txFree()) {
+    txStats.droppedBytes += len;
+    txStats.droppedMessages++;
+    return false;
+  }
+  for (uint32_t i = 0; i < len; i++) {
+    txQueue[(txHead + i) % USB_TX_QUEUE_SIZE] = data[i];
+  }
+  txHead += len;
+  if (txHead - txTail > txStats.maxDepth) txStats.maxDepth = txHead - txTail;
+  return true;
+}
+
+void serviceWebUsbTx() {
+  if (!usb_web.connected()) {
+    txTail = txHead;  // Nobody is listening
+    return;
+  }
+  bool wrote = false;
+  while (txHead != txTail) {
+    const uint32_t space = tud_vendor_write_available();
+    if (space == 0) break;
+    const uint32_t start = txTail % USB_TX_QUEUE_SIZE;
+    const uint32_t len = min(min(txHead - txTail, space), USB_TX_QUEUE_SIZE - start);
+    usb_web.write(txQueue + start, len);
+    txTail += len;
+    txStats.sentBytes += len;
+    wrote = true;
+  }
+  if (wrote) usb_web.flush();
+}
+
+const STR_USB_TX_STATS& getWebUsbTxStats() {
+  txStats.depth = txHead - txTail;
+  return txStats;
+}
+
+// Get chip serial number as a hex string (at least 33 chars)
+static void chipId(char* id, size_t size) {
+  snprintf(id, size, "unknown");
 #ifdef M0_PIO
   volatile uint32_t val1, val2, val3, val4;
   volatile uint32_t *ptr1 = (volatile uint32_t *)0x0080A00C;
@@ -35,21 +116,30 @@ String chipId() {
   ptr++;
   val4 = *ptr;
 
-  char buf[33];
   // NOTE: we're just using the lower 16 bits of the uint32 vals.
-  snprintf(buf, sizeof(buf), "%08x%08x%08x%08x",
+  snprintf(id, size, "%08x%08x%08x%08x",
           (unsigned int)val1,
           (unsigned int)val2,
           (unsigned int)val3,
           (unsigned int)val4);
-  id = String(buf);
 #elif RP_PIO
-  const int kPicoBoardIdLen = 2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1;
-  char buf[kPicoBoardIdLen];
-  pico_get_unique_board_id_string(buf, kPicoBoardIdLen);
-  id = String(buf);
+  pico_get_unique_board_id_string(id, size);
+#endif  // M0_PIO/RP_PIO
+}
+
+// Get the raw chip serial number, zero padded to 16 bytes
+static void chipIdBytes(uint8_t* id) {
+  memset(id, 0, 16);
+#ifdef M0_PIO
+  const uint32_t words[4] = {
+    *(volatile uint32_t *)0x0080A00C, *(volatile uint32_t *)0x0080A040,
+    *(volatile uint32_t *)0x0080A044, *(volatile uint32_t *)0x0080A048};
+  memcpy(id, words, sizeof(words));
+#elif RP_PIO
+  pico_unique_board_id_t board;
+  pico_get_unique_board_id(&board);
+  memcpy(id, board.id, PICO_UNIQUE_BOARD_ID_SIZE_BYTES);
 #endif  // M0_PIO/RP_PIO
-  return id;
 }
 
 // Reboot/reset controller
@@ -65,6 +155,8 @@ void rebootBootloader() {
 void rebootBootloader() {
   TinyUSB_Port_EnterDFU();
 }
+#elif SIL_PIO
+void rebootBootloader() {}
 #endif
 
 /* Example JSON for use with https://arduinojson.org/v6/assistant:
@@ -82,8 +174,198 @@ void rebootBootloader() {
 }
 */
 
+// Binary protocol state. Incoming bytes are read into rxFrame until a delimiter.
+// Replies use the protocol of the last request.
+static bool binaryMode = false;
+static bool rxInFrame = false;    // a 0x00 delimiter started a binary frame
+static bool rxOverflow = false;
+static uint8_t rxFrame[COBS_MAX_ENCODED_SIZE(CONFIG_FRAME_MAX)];
+static uint8_t rxLen = 0;
+static uint8_t lastSeq = 0;
+
+// Frame, crc and COBS encode a message into out, with both delimiters.
+// Returns the number of bytes to send.
+static uint16_t encodeConfigFrame(uint8_t type, uint8_t seq, const uint8_t* payload, uint8_t len, uint8_t* out) {
+  uint8_t frame[CONFIG_FRAME_OVERHEAD + LIVE_PAYLOAD_MAX];
+  frame[0] = type;
+  frame[1] = seq;
+  memcpy(frame + 2, payload, len);
+  const uint16_t crc = crc16(frame, len + 2);
+  frame[len + 2] = crc & 0xFF;
+  frame[len + 3] = crc >> 8;
+  out[0] = 0;
+  const uint16_t n = cobsEncode(frame, len + CONFIG_FRAME_OVERHEAD, out + 1);
+  out[n + 1] = 0;
+  return n + 2;
+}
+
+static void sendConfigFrame(uint8_t type, const uint8_t* payload, uint8_t len) {
+  uint8_t out[LIVE_FRAME_MAX];
+  queueTx(out, encodeConfigFrame(type, lastSeq, payload, len, out));
+}
+
+static void sendConfigError(uint8_t error) {
+  sendConfigFrame(CONFIG_MSG_ERROR, &error, 1);
+}
+
+static void sendConfigMsg(const STR_DEVICE_DATA_140_V1& deviceData) {
+  STR_CONFIG_MSG_140 msg;
+  msg.protocol = CONFIG_PROTOCOL_VERSION;
+  msg.version_major = VERSION_MAJOR;
+  msg.version_minor = VERSION_MINOR;
+#ifdef M0_PIO
+  msg.arch = CONFIG_ARCH_SAMD21;
+#elif RP_PIO
+  msg.arch = CONFIG_ARCH_RP2040;
+#endif
+  msg.armed_seconds = deviceData.armed_seconds;
+  msg.screen_rotation = deviceData.screen_rotation;
+  msg.sea_pressure = deviceData.sea_pressure;
+  msg.metric_temp = deviceData.metric_temp;
+  msg.metric_alt = deviceData.metric_alt;
+  msg.performance_mode = deviceData.performance_mode;
+  msg.batt_size = deviceData.batt_size;
+  msg.btn_mode = deviceData.btn_mode;
+  chipIdBytes(msg.device_id);
+  sendConfigFrame(CONFIG_MSG_CONFIG, reinterpret_cast<uint8_t*>(&msg), sizeof(msg));
+}
+
+// Live telemetry. Samples are delta encoded into the filling packet, which is
+// queued when full or LIVE_LATENCY_MILLIS old. If the queue has no room, the
+// packet is dropped and the codec reset, so the next packet starts with a keyframe.
+static uint16_t liveIntervalMillis = 0;  // 0 = not streaming
+static uint32_t liveLastSampleMillis = 0;
+static uint32_t liveFillStartMillis = 0;
+static STR_LOG_CODEC_STATE liveCodec;
+static uint8_t liveFill[LIVE_PAYLOAD_MAX];
+static uint8_t liveFillLen = 0;
+static uint8_t liveSeq = 0;
+static uint32_t liveFlightTimeMillis = 0;
+
+static void startLive(uint16_t intervalMillis) {
+  liveIntervalMillis = intervalMillis;
+  liveFillLen = 0;
+  resetLogCodec(&liveCodec);
+  liveFlightTimeMillis = millis() - LIVE_FLIGHT_TIME_MILLIS;  // Send the first one right away
+}
+
+// Queue the filling packet. Returns false if it was dropped.
+static bool closeLivePacket() {
+  uint8_t out[LIVE_FRAME_MAX];
+  const uint16_t n = encodeConfigFrame(CONFIG_MSG_LIVE_DATA, liveSeq++, liveFill, liveFillLen, out);
+  liveFillLen = 0;
+  if (queueTx(out, n)) return true;
+  resetLogCodec(&liveCodec);
+  return false;
+}
+
+void queueLiveTelemetry(const STR_FLIGHT_RECORD_140& record) {
+  if (liveIntervalMillis == 0) return;
+  if (record.millis - liveLastSampleMillis < liveIntervalMillis) return;
+  liveLastSampleMillis = record.millis;
+
+  uint8_t frame[LOG_CODEC_MAX_FRAME_SIZE];
+  uint8_t len = encodeFlightRecord(&liveCodec, record, frame);
+  if (liveFillLen + len > LIVE_PAYLOAD_MAX && !closeLivePacket()) {
+    len = encodeFlightRecord(&liveCodec, record, frame);  // The host is behind, start over
+  }
+  if (len > LIVE_PAYLOAD_MAX) {
+    resetLogCodec(&liveCodec);  // Skip an oversized keyframe, try again with the next sample
+    return;
+  }
+  if (liveFillLen == 0) liveFillStartMillis = record.millis;
+  memcpy(liveFill + liveFillLen, frame, len);
+  liveFillLen += len;
+}
+
+void serviceWebUsbLive() {
+  if (liveIntervalMillis == 0) return;
+  if (!usb_web.connected()) {
+    liveIntervalMillis = 0;
+    return;
+  }
+  if (liveFillLen > 0 && millis() - liveFillStartMillis >= LIVE_LATENCY_MILLIS) closeLivePacket();
+  // The estimate can't be requested while armed, so the stream carries it
+  if (millis() - liveFlightTimeMillis >= LIVE_FLIGHT_TIME_MILLIS) {
+    liveFlightTimeMillis = millis();
+    sendConfigFrame(CONFIG_MSG_FLIGHT_TIME_DATA, reinterpret_cast<const uint8_t*>(&getFlightTimeEstimate()),
+                    sizeof(STR_FLIGHT_TIME_ESTIMATE));
+  }
+}
+
+bool webUsbLiveActive() {
+  return liveIntervalMillis != 0;
+}
+
+// Handle one decoded binary frame. Returns true if deviceData was changed.
+static bool handleConfigFrame(uint8_t* frame, uint8_t len, STR_DEVICE_DATA_140_V1* deviceData) {
+  len = cobsDecode(frame, len, frame);
+  if (len < CONFIG_FRAME_OVERHEAD) {
+    sendConfigError(CONFIG_ERROR_FRAME);
+    return false;
+  }
+  const uint8_t payloadLen = len - CONFIG_FRAME_OVERHEAD;
+  const uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+  lastSeq = frame[1];
+  if (crc != crc16(frame, len - 2)) {
+    sendConfigError(CONFIG_ERROR_FRAME);
+    return false;
+  }
+
+  switch (frame[0]) {
+  case CONFIG_MSG_GET:
+    sendConfigMsg(*deviceData);
+    return false;
+  case CONFIG_MSG_SET: {
+    if (payloadLen != sizeof(STR_CONFIG_MSG_140)) {
+      sendConfigError(CONFIG_ERROR_FRAME);
+      return false;
+    }
+    STR_CONFIG_MSG_140 msg;
+    memcpy(&msg, frame + 2, sizeof(msg));
+    deviceData->screen_rotation = msg.screen_rotation;
+    deviceData->sea_pressure = msg.sea_pressure;
+    deviceData->metric_temp = msg.metric_temp;
+    deviceData->metric_alt = msg.metric_alt;
+    deviceData->performance_mode = msg.performance_mode;
+    deviceData->batt_size = msg.batt_size;
+    deviceData->btn_mode = msg.btn_mode;
+    return true;  // the caller saves it and replies with sendWebUsbSerial()
+  }
+  case CONFIG_MSG_LIVE:
+    if (payloadLen != 2) {
+      sendConfigError(CONFIG_ERROR_FRAME);
+      return false;
+    }
+    startLive(frame[2] | (frame[3] << 8));
+    return false;
+  case CONFIG_MSG_PROFILE:
+    if (payloadLen != 2) {
+      sendConfigError(CONFIG_ERROR_FRAME);
+      return false;
+    }
+    startProfiler(frame[2] | (frame[3] << 8));
+    return false;
+  case CONFIG_MSG_FLIGHT_TIME:
+    sendConfigFrame(CONFIG_MSG_FLIGHT_TIME_DATA, reinterpret_cast<const uint8_t*>(&getFlightTimeEstimate()),
+                    sizeof(STR_FLIGHT_TIME_ESTIMATE));
+    return false;
+  case CONFIG_MSG_REBOOT_BL:
+    flushDeviceData();  // Don't lose a queued write
+    rebootBootloader();
+    return false;
+  default:
+    sendConfigError(CONFIG_ERROR_TYPE);
+    return false;
+  }
+}
+
 void sendWebUsbSerial(const STR_DEVICE_DATA_140_V1& deviceData) {
-  DynamicJsonDocument doc(256);  // See discussion of ArduinoJson Assistant, above.
+  if (binaryMode) {
+    sendConfigMsg(deviceData);
+    return;
+  }
+  StaticJsonDocument<256> doc;  // See discussion of ArduinoJson Assistant, above.
 
 #ifdef M0_PIO
   doc["arch"] = "SAMD21";
@@ -97,36 +379,91 @@ void sendWebUsbSerial(const STR_DEVICE_DATA_140_V1& deviceData) {
   doc["armed_time"] = static_cast<int>(deviceData.armed_seconds);
   doc["metric_temp"] = deviceData.metric_temp;
   doc["metric_alt"] = deviceData.metric_alt;
-  // HACK: There appears to be an issue with usb_web println, which causes the rp2040 to hang
-  // if you try to send more than ~128 bytes!?! So just send partial information.
-  // doc["performance_mode"] = deviceData.performance_mode;
-  // doc["batt_size"] = static_cast<int>(deviceData.batt_size);
-  // doc["sea_pressure"] = static_cast<float>(deviceData.sea_pressure);
-  // doc["device_id"] = chipId().c_str();
-
-  char output[256];
-  // Serial.println("serializeJSON");
-  serializeJson(doc, output, sizeof(output));
-  // Serial.println(output);
-  // Serial.println(strlen(output));
-  if (usb_web.connected()) {
-    // Serial.println("Sending over usb_web");
-    // There appears to be an issue with usb_web println and long outputs which causes a hang!
-    usb_web.println(output);
-    usb_web.flush();
+  doc["performance_mode"] = deviceData.performance_mode;
+  doc["batt_size"] = static_cast<int>(deviceData.batt_size);
+  doc["sea_pressure"] = static_cast<float>(deviceData.sea_pressure);
+  // Static, so the document can hold a pointer to it instead of a copy
+  static char deviceId[33] = "";
+  if (!deviceId[0]) chipId(deviceId, sizeof(deviceId));
+  doc["device_id"] = static_cast<const char*>(deviceId);
+
+  char output[256 + 2];
+  size_t len = serializeJson(doc, output, sizeof(output) - 2);
+  output[len++] = '\r';
+  output[len++] = '\n';
+  queueTx(reinterpret_cast<uint8_t*>(output), len);
+}
+
+// Send the range of flight numbers available for download, and whether more are still being copied
+void sendWebUsbFlights() {
+  uint32_t oldest = 0, newest = 0;
+  getFlightRange(&oldest, &newest);
+  char output[80];
+  const int len = snprintf(output, sizeof(output), "{\"oldest\":%u,\"newest\":%u,\"pending\":%s}\r\n",
+                           static_cast<unsigned int>(oldest), static_cast<unsigned int>(newest),
+                           isFlightCopyPending() ? "true" : "false");
+  queueTx(reinterpret_cast<uint8_t*>(output), len);
+}
+
+// Send the remaining flight time estimate, minutes is null when unknown
+static void sendWebUsbFlightTime() {
+  const STR_FLIGHT_TIME_ESTIMATE& estimate = getFlightTimeEstimate();
+  char minutes[8] = "null";
+  if (estimate.minutes != FLIGHT_TIME_UNKNOWN) {
+    snprintf(minutes, sizeof(minutes), "%u", static_cast<unsigned int>(estimate.minutes));
   }
+  char output[96];
+  const int len = snprintf(output, sizeof(output),
+                           "{\"remaining_min\":%s,\"remaining_wh\":%d,\"battery_pct\":%u,\"avg_w\":%d}\r\n",
+                           minutes, static_cast<int>(estimate.remainingMilliwattHours / 1000),
+                           static_cast<unsigned int>(estimate.batteryPercent), static_cast<int>(estimate.avgWatts));
+  queueTx(reinterpret_cast<uint8_t*>(output), len);
 }
 
-bool parseWebUsbSerial(STR_DEVICE_DATA_140_V1* deviceData) {
-  if (!usb_web.available()) return false;
-  DynamicJsonDocument doc(256);
+// Parse a JSON request from the config page. Returns true if deviceData was changed.
+static bool parseJsonConfig(STR_DEVICE_DATA_140_V1* deviceData) {
+  StaticJsonDocument<256> doc;
   deserializeJson(doc, usb_web);
 
   if (doc["command"] && doc["command"] == "rbl") {
+    flushDeviceData();  // Don't lose a queued write
     rebootBootloader();
     return false;  // run only the command
   }
 
+  // Download a flight file: {"command": "dl", "flight": 12, "offset": 0}
+  // flight 0 is the catalog, DOWNLOAD_PROFILE the profiler snapshot.
+  // Resume an interrupted download with its offset.
+  if (doc["command"] && doc["command"] == "dl") {
+    downloadFlight = doc["flight"].as<unsigned int>();
+    downloadOffset = doc["offset"].as<unsigned int>();
+    downloading = true;
+    return false;
+  }
+  if (doc["command"] && doc["command"] == "dlstop") {
+    stopWebUsbDownload();
+    return false;
+  }
+  // Stream live telemetry: {"command": "live", "interval": 20}, interval 0 stops.
+  // Samples are sent as binary CONFIG_MSG_LIVE_DATA frames.
+  if (doc["command"] && doc["command"] == "live") {
+    startLive(doc["interval"].as<unsigned int>());
+    return false;
+  }
+  // Restart the profiler: {"command": "profile", "hz": 1000}, hz 0 stops sampling
+  if (doc["command"] && doc["command"] == "profile") {
+    startProfiler(doc["hz"].as<unsigned int>());
+    return false;
+  }
+  if (doc["command"] && doc["command"] == "flights") {
+    sendWebUsbFlights();
+    return false;
+  }
+  if (doc["command"] && doc["command"] == "flighttime") {
+    sendWebUsbFlightTime();
+    return false;
+  }
+
   if (doc["major_v"] < 5) return false;
 
   // HACK: Only accept key fields.
@@ -139,8 +476,111 @@ bool parseWebUsbSerial(STR_DEVICE_DATA_140_V1* deviceData) {
   return true;
 }
 
+bool parseWebUsbSerial(STR_DEVICE_DATA_140_V1* deviceData) {
+  while (usb_web.available()) {
+    // JSON requests start with '{', binary frames with a 0x00 delimiter.
+    // A config frame is too short to start with the COBS code '{'.
+    if (rxLen == 0 && usb_web.peek() == '{') {
+      binaryMode = false;
+      rxInFrame = false;
+      return parseJsonConfig(deviceData);
+    }
+    const int c = usb_web.read();
+    if (c != 0) {
+      if (!rxInFrame) continue;  // Noise between requests, e.g. a newline
+      if (rxLen < sizeof(rxFrame)) {
+        rxFrame[rxLen++] = c;
+      } else {
+        rxOverflow = true;
+      }
+      continue;
+    }
+    if (!rxInFrame || rxLen == 0) {
+      rxInFrame = true;  // Start of a frame, or back to back delimiters
+      continue;
+    }
+    // The delimiter that ends this frame also starts the next one
+    binaryMode = true;
+    const uint8_t len = rxLen;
+    const bool overflow = rxOverflow;
+    rxOverflow = false;
+    rxLen = 0;
+    if (overflow) {
+      sendConfigError(CONFIG_ERROR_FRAME);
+      return false;
+    }
+    return handleConfigFrame(rxFrame, len, deviceData);
+  }
+  return false;
+}
+
+// Send one chunk of at most len data bytes. Returns false when the download is over.
+static bool sendDownloadChunk(uint16_t len) {
+  uint8_t frame[DOWNLOAD_OVERHEAD + DOWNLOAD_CHUNK_MAX];
+  STR_DOWNLOAD_CHUNK_HEADER header;
+  header.magic = DOWNLOAD_CHUNK_MAGIC;
+  header.flightNumber = downloadFlight;
+  header.offset = downloadOffset;
+  uint8_t* data = frame + sizeof(header);
+  const int32_t n = downloadFlight == DOWNLOAD_PROFILE ? readProfile(downloadOffset, data, len)
+                                                       : readFlightFile(downloadFlight, downloadOffset, data, len);
+  header.length = n > 0 ? n : 0;
+  if (n < 0) {
+    header.offset = DOWNLOAD_NO_FILE;
+  } else if (n == 0) {
+    // The end chunk carries the file size, also when asked to start past the end
+    header.offset = downloadFlight == DOWNLOAD_PROFILE ? getProfileSize() : getFlightFileSize(downloadFlight);
+  }
+  memcpy(frame, &header, sizeof(header));
+  const uint16_t crc = crc16(frame, sizeof(header) + header.length);
+  frame[sizeof(header) + header.length] = crc & 0xFF;
+  frame[sizeof(header) + header.length + 1] = crc >> 8;
+  queueTx(frame, DOWNLOAD_OVERHEAD + header.length);
+  downloadOffset += header.length;
+  return header.length > 0;
+}
+
+void serviceWebUsbDownload() {
+  if (!downloading) return;
+  if (!usb_web.connected()) {
+    stopWebUsbDownload();
+    return;
+  }
+  const uint32_t startMicros = micros();
+  while (downloading && micros() - startMicros < DOWNLOAD_BUDGET_MICROS) {
+    // Only read what the queue can take right now. Once it is full, carry on
+    // next call rather than waiting here for the host.
+    const uint32_t space = txFree();
+    if (space < DOWNLOAD_OVERHEAD + DOWNLOAD_CHUNK_MIN) break;
+    downloading = sendDownloadChunk(min(space - DOWNLOAD_OVERHEAD, static_cast<uint32_t>(DOWNLOAD_CHUNK_MAX)));
+  }
+  serviceWebUsbTx();
+}
+
+void stopWebUsbDownload() {
+  downloading = false;
+}
+
+bool webUsbDownloadActive() {
+  return downloading;
+}
+
+static void (*userLineStateCallback)(bool connected) = nullptr;
+
+// Every new connection starts in JSON mode, for the config page
+static void webUsbLineStateCallback(bool connected) {
+  liveIntervalMillis = 0;
+  txTail = txHead;  // Drop anything left from the last connection
+  binaryMode = false;
+  rxInFrame = false;
+  rxOverflow = false;
+  rxLen = 0;
+  if (userLineStateCallback) userLineStateCallback(connected);
+}
+
 void setupWebUsbSerial(void (*lineStateCallback)(bool connected)) {
+  userLineStateCallback = lineStateCallback;
   usb_web.setLandingPage(&landingPage);
-  usb_web.setLineStateCallback(lineStateCallback);
+  usb_web.setLineStateCallback(webUsbLineStateCallback);
   usb_web.begin();
 }
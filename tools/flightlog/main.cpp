@@ -0,0 +1,347 @@
+// Host-side flight log decoder and analytics.
+//
+//   flightlog summary [--temp-limit C] FILES...
+//   flightlog export [--format csv|columns] [-o DIR] FILES...
+//
+// Files are memory-mapped and decoded in a single streaming pass, one file
+// per worker thread. Summaries are printed as CSV in input order.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sp140/flight_log.h"
+#include "sp140/log_codec.h"
+#include "sp140/structs.h"
+
+#define STATUS_FLAG_BITS  6  // See STR_ESC_TELEMETRY_140
+
+struct Options {
+  std::string command;
+  std::string format = "csv";
+  std::string outDir = ".";
+  float tempLimit = 80;
+  std::vector<std::string> files;
+};
+
+struct FlightSummary {
+  bool ok = false;
+  std::string error;
+  STR_FLIGHT_LOG_HEADER header = {};
+  uint32_t records = 0;
+  uint32_t firstMillis = 0;
+  uint32_t lastMillis = 0;
+  float startWattHours = 0;
+  float endWattHours = 0;
+  float peakWatts = 0;
+  float peakAmps = 0;
+  float minVolts = 0;
+  float maxTemperatureC = 0;
+  float secondsAboveTempLimit = 0;
+  uint32_t staleRecords = 0;
+  uint32_t statusFlagEvents[STATUS_FLAG_BITS] = {};
+  uint8_t lastStatusFlag = 0;
+};
+
+// Read-only memory map of a whole file
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        data_ = static_cast<const uint8_t*>(data);
+        size_ = st.st_size;
+        madvise(data, size_, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Version 1 record: raw and float based, before ESC telemetry went fixed-point.
+// Frozen here so old files still decode after STR_FLIGHT_RECORD_140 changes.
+#pragma pack(push, 1)
+struct FlightRecordV1 {
+  uint32_t millis;
+  uint16_t throttlePWM;
+  float volts;
+  float temperatureC;
+  float amps;
+  float watts;
+  float wattHours;
+  float rpm;
+  float inPWM;
+  float outPWM;
+  uint8_t statusFlag;
+  float altitude;
+  uint8_t stateFlags;
+};
+#pragma pack(pop)
+static_assert(sizeof(FlightRecordV1) == 44, "version 1 record size");
+
+STR_FLIGHT_RECORD_140 upgradeRecord(const FlightRecordV1& v1) {
+  STR_FLIGHT_RECORD_140 r;
+  r.millis = v1.millis;
+  r.throttlePWM = v1.throttlePWM;
+  r.centiVolts = lroundf(v1.volts * 100);
+  r.deciCelsius = lroundf(v1.temperatureC * 10);
+  r.centiAmps = lroundf(v1.amps * 100);
+  r.watts = lroundf(v1.watts);
+  r.milliwattHours = lroundf(v1.wattHours * 1000);
+  r.rpm = lroundf(v1.rpm);
+  r.inPWM = lroundf(v1.inPWM);
+  r.outPWM = lroundf(v1.outPWM);
+  r.statusFlag = v1.statusFlag;
+  r.altitude = v1.altitude;
+  r.stateFlags = v1.stateFlags;
+  return r;
+}
+
+// Calls onRecord for every record of a flight file. Returns an error message, or "".
+template <typename F>
+std::string decodeFlightFile(const MappedFile& file, STR_FLIGHT_LOG_HEADER* header, F onRecord) {
+  if (!file.data()) return "cannot read file";
+  if (file.size() < sizeof(*header)) return "file too short";
+  memcpy(header, file.data(), sizeof(*header));
+  if (header->magic != FLIGHT_LOG_MAGIC) return "not a flight log";
+
+  const uint8_t* pos = file.data() + sizeof(*header);
+  const uint8_t* end = file.data() + file.size();
+  STR_FLIGHT_RECORD_140 record;
+  if (header->version == 1) {
+    // Raw records
+    FlightRecordV1 v1;
+    if (header->recordSize != sizeof(v1)) return "unexpected record size";
+    for (; pos + sizeof(v1) <= end; pos += sizeof(v1)) {
+      memcpy(&v1, pos, sizeof(v1));
+      onRecord(upgradeRecord(v1));
+    }
+    return "";
+  }
+  if (header->version != FLIGHT_LOG_VERSION) return "unsupported version";
+
+  STR_LOG_CODEC_STATE state;
+  resetLogCodec(&state);
+  while (pos < end) {
+    const uint8_t used = decodeFlightRecord(&state, pos, end - pos, &record);
+    if (used == 0) return "truncated or corrupt record";
+    onRecord(record);
+    pos += used;
+  }
+  return "";
+}
+
+FlightSummary summarizeFlight(const std::string& path, float tempLimit) {
+  FlightSummary s;
+  MappedFile file(path);
+  s.error = decodeFlightFile(file, &s.header, [&](const STR_FLIGHT_RECORD_140& r) {
+    const float volts = r.centiVolts / 100.0f;
+    const float temperatureC = r.deciCelsius / 10.0f;
+    if (s.records == 0) {
+      s.firstMillis = r.millis;
+      s.startWattHours = r.milliwattHours / 1000.0f;
+      s.minVolts = volts;
+      s.maxTemperatureC = temperatureC;
+    } else if (temperatureC > tempLimit) {
+      s.secondsAboveTempLimit += (r.millis - s.lastMillis) / 1000.0;
+    }
+    s.records++;
+    s.lastMillis = r.millis;
+    s.endWattHours = r.milliwattHours / 1000.0f;
+    if (r.stateFlags & FLIGHT_FLAG_ESC_STALE) {
+      s.staleRecords++;
+      return;  // Telemetry values are old
+    }
+    if (r.watts > s.peakWatts) s.peakWatts = r.watts;
+    if (r.centiAmps / 100.0f > s.peakAmps) s.peakAmps = r.centiAmps / 100.0f;
+    if (volts < s.minVolts) s.minVolts = volts;
+    if (temperatureC > s.maxTemperatureC) s.maxTemperatureC = temperatureC;
+    const uint8_t rising = r.statusFlag & ~s.lastStatusFlag;
+    for (int bit = 0; bit < STATUS_FLAG_BITS; bit++) {
+      if (rising & (1 << bit)) s.statusFlagEvents[bit]++;
+    }
+    s.lastStatusFlag = r.statusFlag;
+  });
+  // Keep what was decoded before a truncated tail (e.g. power off while armed)
+  s.ok = s.error.empty() || s.records > 0;
+  return s;
+}
+
+void printSummaryHeader() {
+  printf("file,flight,records,duration_s,energy_wh,peak_w,peak_a,min_v,max_temp_c,s_above_temp_limit,"
+         "stale_records,motor_started,saturation,over_temp,over_volt,under_volt,startup_error,error\n");
+}
+
+void printSummary(const std::string& path, const FlightSummary& s) {
+  printf("%s,%u,%u,%.1f,%.2f,%.0f,%.1f,%.2f,%.1f,%.1f,%u",
+         path.c_str(), s.header.flightNumber, s.records, (s.lastMillis - s.firstMillis) / 1000.0,
+         s.endWattHours - s.startWattHours, s.peakWatts, s.peakAmps, s.minVolts, s.maxTemperatureC,
+         s.secondsAboveTempLimit, s.staleRecords);
+  for (int bit = 0; bit < STATUS_FLAG_BITS; bit++) printf(",%u", s.statusFlagEvents[bit]);
+  printf(",%s\n", s.error.c_str());
+}
+
+std::string baseName(const std::string& path) {
+  std::string name = path.substr(path.find_last_of('/') + 1);
+  const size_t dot = name.find_last_of('.');
+  return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// One CSV row per record
+std::string exportCsv(const std::string& path, const std::string& outDir) {
+  MappedFile file(path);
+  const std::string outPath = outDir + "/" + baseName(path) + ".csv";
+  FILE* out = fopen(outPath.c_str(), "w");
+  if (!out) return "cannot create " + outPath;
+  static thread_local char buffer[1 << 20];
+  setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+  fprintf(out, "millis,throttle_pwm,volts,temperature_c,amps,watts,watt_hours,rpm,in_pwm,out_pwm,"
+               "status_flag,altitude_m,state_flags\n");
+  STR_FLIGHT_LOG_HEADER header;
+  const std::string error = decodeFlightFile(file, &header, [&](const STR_FLIGHT_RECORD_140& r) {
+    fprintf(out, "%u,%u,%.2f,%.1f,%.2f,%d,%.2f,%u,%u,%u,%u,", r.millis, r.throttlePWM, r.centiVolts / 100.0,
+            r.deciCelsius / 10.0, r.centiAmps / 100.0, r.watts, r.milliwattHours / 1000.0, r.rpm, r.inPWM,
+            r.outPWM, r.statusFlag);
+    if (r.altitude == __FLT_MIN__) fprintf(out, ",%u\n", r.stateFlags);
+    else fprintf(out, "%.1f,%u\n", r.altitude, r.stateFlags);
+  });
+  fclose(out);
+  return error;
+}
+
+// One little-endian binary file per column, plus a schema listing them
+std::string exportColumns(const std::string& path, const std::string& outDir) {
+  static const char* kColumns[] = {
+    "millis.u32", "throttle_pwm.u16", "volts.f32", "temperature_c.f32", "amps.f32", "watts.f32",
+    "watt_hours.f32", "rpm.f32", "in_pwm.f32", "out_pwm.f32", "status_flag.u8", "altitude_m.f32",
+    "state_flags.u8"};
+  const int kColumnCount = sizeof(kColumns) / sizeof(kColumns[0]);
+  MappedFile file(path);
+  const std::string dir = outDir + "/" + baseName(path);
+  mkdir(dir.c_str(), 0755);
+  FILE* columns[kColumnCount];
+  for (int i = 0; i < kColumnCount; i++) {
+    columns[i] = fopen((dir + "/" + kColumns[i]).c_str(), "wb");
+    if (!columns[i]) {
+      while (i-- > 0) fclose(columns[i]);
+      return "cannot create " + dir;
+    }
+  }
+  uint32_t records = 0;
+  STR_FLIGHT_LOG_HEADER header;
+  const std::string error = decodeFlightFile(file, &header, [&](const STR_FLIGHT_RECORD_140& r) {
+    fwrite(&r.millis, sizeof(r.millis), 1, columns[0]);
+    fwrite(&r.throttlePWM, sizeof(r.throttlePWM), 1, columns[1]);
+    const float floats[] = {r.centiVolts / 100.0f, r.deciCelsius / 10.0f, r.centiAmps / 100.0f,
+                            static_cast<float>(r.watts), r.milliwattHours / 1000.0f, static_cast<float>(r.rpm),
+                            static_cast<float>(r.inPWM), static_cast<float>(r.outPWM)};
+    for (int i = 0; i < 8; i++) fwrite(&floats[i], sizeof(float), 1, columns[2 + i]);
+    fwrite(&r.statusFlag, sizeof(r.statusFlag), 1, columns[10]);
+    const float altitude = r.altitude == __FLT_MIN__ ? NAN : r.altitude;
+    fwrite(&altitude, sizeof(altitude), 1, columns[11]);
+    fwrite(&r.stateFlags, sizeof(r.stateFlags), 1, columns[12]);
+    records++;
+  });
+  for (int i = 0; i < kColumnCount; i++) fclose(columns[i]);
+
+  FILE* schema = fopen((dir + "/schema.csv").c_str(), "w");
+  if (schema) {
+    fprintf(schema, "column,rows\n");
+    for (int i = 0; i < kColumnCount; i++) fprintf(schema, "%s,%u\n", kColumns[i], records);
+    fclose(schema);
+  }
+  return error;
+}
+
+// Run job(i) for every file, spread over all cores
+template <typename F>
+void parallelFor(size_t count, F job) {
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> workers;
+  const unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int t = 0; t < threads && t < count; t++) {
+    workers.emplace_back([&]() {
+      for (size_t i = next++; i < count; i = next++) job(i);
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+}
+
+int usage() {
+  fprintf(stderr,
+          "usage: flightlog summary [--temp-limit C] FILES...\n"
+          "       flightlog export [--format csv|columns] [-o DIR] FILES...\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (argc < 3) return usage();
+  options.command = argv[1];
+  for (int i = 2; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--temp-limit" && i + 1 < argc) options.tempLimit = atof(argv[++i]);
+    else if (arg == "--format" && i + 1 < argc) options.format = argv[++i];
+    else if (arg == "-o" && i + 1 < argc) options.outDir = argv[++i];
+    else options.files.push_back(arg);
+  }
+  if (options.files.empty()) return usage();
+
+  if (options.command == "summary") {
+    std::vector<FlightSummary> summaries(options.files.size());
+    parallelFor(options.files.size(), [&](size_t i) {
+      summaries[i] = summarizeFlight(options.files[i], options.tempLimit);
+    });
+    printSummaryHeader();
+    int failed = 0;
+    for (size_t i = 0; i < summaries.size(); i++) {
+      printSummary(options.files[i], summaries[i]);
+      if (!summaries[i].ok) failed++;
+    }
+    return failed ? 1 : 0;
+  }
+
+  if (options.command == "export") {
+    if (options.format != "csv" && options.format != "columns") return usage();
+    std::vector<std::string> errors(options.files.size());
+    parallelFor(options.files.size(), [&](size_t i) {
+      errors[i] = options.format == "csv" ? exportCsv(options.files[i], options.outDir)
+                                          : exportColumns(options.files[i], options.outDir);
+    });
+    int failed = 0;
+    for (size_t i = 0; i < errors.size(); i++) {
+      if (errors[i].empty()) continue;
+      fprintf(stderr, "%s: %s\n", options.files[i].c_str(), errors[i].c_str());
+      failed++;
+    }
+    return failed ? 1 : 0;
+  }
+  return usage();
+}
@@ -0,0 +1,160 @@
+// Host-side report of a profiler snapshot downloaded from the controller.
+//
+//   profiler [--addr2line PATH] [--top N] firmware.elf profile.bin
+//
+// Prints the CPU load, the time spent in each task, and the sampled pcs
+// grouped by function, symbolized with addr2line against the firmware ELF
+// that was running on the controller.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sp140/structs.h"
+
+#define ADDR2LINE_BATCH  64  // pcs per addr2line run
+
+struct Options {
+  std::string addr2line = "arm-none-eabi-addr2line";
+  size_t top = 30;
+  std::string elf;
+  std::string profile;
+};
+
+struct FunctionSamples {
+  std::string name;
+  uint32_t samples = 0;
+  uint32_t hottestCount = 0;
+  std::string hottestLocation;  // file:line of the pc with the most samples
+};
+
+struct Symbol {
+  std::string function;
+  std::string location;
+};
+
+std::string shellQuote(const std::string& s) {
+  std::string quoted = "'";
+  for (char c : s) quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+  return quoted + "'";
+}
+
+// Look up every pc. addr2line prints two lines per address: function, file:line.
+bool symbolize(const Options& options, const std::vector<STR_PROFILE_SLOT>& slots, std::vector<Symbol>* symbols) {
+  for (size_t start = 0; start < slots.size(); start += ADDR2LINE_BATCH) {
+    std::string command = shellQuote(options.addr2line) + " -f -C -e " + shellQuote(options.elf);
+    const size_t end = std::min(slots.size(), start + ADDR2LINE_BATCH);
+    for (size_t i = start; i < end; i++) {
+      char address[16];
+      snprintf(address, sizeof(address), " 0x%08x", slots[i].pc);
+      command += address;
+    }
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) return false;
+    char line[512];
+    for (size_t i = start; i < end; i++) {
+      Symbol symbol;
+      if (fgets(line, sizeof(line), pipe)) symbol.function = std::string(line, strcspn(line, "\n"));
+      if (fgets(line, sizeof(line), pipe)) symbol.location = std::string(line, strcspn(line, "\n"));
+      symbols->push_back(symbol);
+    }
+    if (pclose(pipe) != 0) return false;
+  }
+  return true;
+}
+
+int usage() {
+  fprintf(stderr, "usage: profiler [--addr2line PATH] [--top N] firmware.elf profile.bin\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--addr2line" && i + 1 < argc) options.addr2line = argv[++i];
+    else if (arg == "--top" && i + 1 < argc) options.top = atoi(argv[++i]);
+    else files.push_back(arg);
+  }
+  if (files.size() != 2) return usage();
+  options.elf = files[0];
+  options.profile = files[1];
+
+  std::ifstream file(options.profile, std::ios::binary);
+  if (!file) {
+    perror(options.profile.c_str());
+    return 1;
+  }
+  const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  STR_PROFILE_HEADER header;
+  if (data.size() < sizeof(header)) {
+    fprintf(stderr, "%s: too short\n", options.profile.c_str());
+    return 1;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  const size_t expected = sizeof(header) + header.taskCount * sizeof(STR_PROFILE_TASK) +
+                          header.slotCount * sizeof(STR_PROFILE_SLOT);
+  if (header.magic != PROFILE_MAGIC || header.version != PROFILE_VERSION || data.size() < expected) {
+    fprintf(stderr, "%s: not a profile, or an unsupported version\n", options.profile.c_str());
+    return 1;
+  }
+
+  std::vector<STR_PROFILE_TASK> tasks(header.taskCount);
+  memcpy(tasks.data(), data.data() + sizeof(header), tasks.size() * sizeof(STR_PROFILE_TASK));
+  std::vector<STR_PROFILE_SLOT> slots(header.slotCount);
+  memcpy(slots.data(), data.data() + sizeof(header) + tasks.size() * sizeof(STR_PROFILE_TASK),
+         slots.size() * sizeof(STR_PROFILE_SLOT));
+
+  const double seconds = header.durationMillis / 1000.0;
+  printf("firmware %u.%u, %.1f s, %u samples at %u Hz (%u dropped)\n", header.version_major,
+         header.version_minor, seconds, header.samples, header.sampleHz, header.droppedSamples);
+  printf("load: core0 %.1f%% (peak %.1f%%), core1 %.1f%% (peak %.1f%%)\n",
+         header.load.busyPermille[0] / 10.0, header.load.peakBusyPermille[0] / 10.0,
+         header.load.busyPermille[1] / 10.0, header.load.peakBusyPermille[1] / 10.0);
+  printf("headroom: core0 idle %.1f%% (lowest %.1f%%)\n\n", header.load.idlePermille / 10.0,
+         header.load.minIdlePermille / 10.0);
+
+  printf("task,runs,busy_ms,busy_percent,avg_us,samples,sample_percent\n");
+  for (const STR_PROFILE_TASK& task : tasks) {
+    const std::string name(task.name, strnlen(task.name, sizeof(task.name)));
+    printf("%s,%u,%u,%.2f,%.1f,%u,%.2f\n", name.c_str(), task.runs, task.busyMillis,
+           seconds > 0 ? task.busyMillis / 10.0 / seconds : 0, task.runs ? task.busyMillis * 1000.0 / task.runs : 0,
+           task.samples, header.samples ? 100.0 * task.samples / header.samples : 0);
+  }
+  if (slots.empty()) return 0;
+
+  std::vector<Symbol> symbols;
+  if (!symbolize(options, slots, &symbols)) {
+    fprintf(stderr, "%s failed, is it on the PATH? (--addr2line)\n", options.addr2line.c_str());
+    return 1;
+  }
+  std::map<std::string, FunctionSamples> functions;
+  for (size_t i = 0; i < slots.size(); i++) {
+    FunctionSamples& f = functions[symbols[i].function];
+    f.name = symbols[i].function;
+    f.samples += slots[i].count;
+    if (slots[i].count > f.hottestCount) {
+      f.hottestCount = slots[i].count;
+      f.hottestLocation = symbols[i].location;
+    }
+  }
+  std::vector<FunctionSamples> sorted;
+  for (const auto& entry : functions) sorted.push_back(entry.second);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const FunctionSamples& a, const FunctionSamples& b) { return a.samples > b.samples; });
+
+  printf("\nsamples,percent,function,hottest_line\n");
+  for (size_t i = 0; i < sorted.size() && i < options.top; i++) {
+    printf("%u,%.2f,\"%s\",%s\n", sorted[i].samples, 100.0 * sorted[i].samples / header.samples,
+           sorted[i].name.c_str(), sorted[i].hottestLocation.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef TOOLS_SIL_ARDUINO_ADAFRUIT_BMP3XX_H_
+#define TOOLS_SIL_ARDUINO_ADAFRUIT_BMP3XX_H_
+
+#include <Arduino.h>
+
+#define BMP3_ODR_25_HZ             0x03
+#define BMP3_OVERSAMPLING_2X       0x01
+#define BMP3_OVERSAMPLING_4X       0x02
+#define BMP3_IIR_FILTER_COEFF_15   0x04
+
+// Barometer reporting the scripted altitude
+class Adafruit_BMP3XX {
+ public:
+  bool begin_I2C();
+  bool setOutputDataRate(uint8_t) { return true; }
+  bool setTemperatureOversampling(uint8_t) { return true; }
+  bool setPressureOversampling(uint8_t) { return true; }
+  bool setIIRFilterCoeff(uint8_t) { return true; }
+  float readAltitude(float seaLevel);
+};
+
+#endif  // TOOLS_SIL_ARDUINO_ADAFRUIT_BMP3XX_H_
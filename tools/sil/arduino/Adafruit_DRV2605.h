@@ -0,0 +1,21 @@
+#ifndef TOOLS_SIL_ARDUINO_ADAFRUIT_DRV2605_H_
+#define TOOLS_SIL_ARDUINO_ADAFRUIT_DRV2605_H_
+
+#include <Arduino.h>
+
+#define DRV2605_MODE_INTTRIG  0x00
+
+// Haptic driver, go() is logged as a vibration event
+class Adafruit_DRV2605 {
+ public:
+  bool begin() { return true; }
+  bool selectLibrary(uint8_t) { return true; }
+  void setMode(uint8_t) {}
+  void setWaveform(uint8_t slot, uint8_t waveform) { if (slot < 8) waveforms_[slot] = waveform; }
+  void go();
+
+ private:
+  uint8_t waveforms_[8] = {};
+};
+
+#endif  // TOOLS_SIL_ARDUINO_ADAFRUIT_DRV2605_H_
@@ -0,0 +1,43 @@
+#ifndef TOOLS_SIL_ARDUINO_ADAFRUIT_GFX_H_
+#define TOOLS_SIL_ARDUINO_ADAFRUIT_GFX_H_
+
+#include <Arduino.h>
+
+// Drawing is discarded, text output is kept for the current line only
+class Adafruit_GFX : public Print {
+ public:
+  Adafruit_GFX(int16_t w, int16_t h) : width_(w), height_(h) {}
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+  void fillScreen(uint16_t) {}
+  void setTextWrap(bool) {}
+  void setTextSize(uint8_t) {}
+  void setTextColor(uint16_t) {}
+  void setTextColor(uint16_t, uint16_t) {}
+  void setCursor(int16_t, int16_t) {}
+  void setRotation(uint8_t) {}
+  void drawPixel(int16_t, int16_t, uint16_t) {}
+  void drawLine(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void drawFastHLine(int16_t, int16_t, int16_t, uint16_t) {}
+  void drawFastVLine(int16_t, int16_t, int16_t, uint16_t) {}
+  void drawRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void fillRect(int16_t, int16_t, int16_t, int16_t, uint16_t) {}
+  void drawCircle(int16_t, int16_t, int16_t, uint16_t) {}
+  void fillCircle(int16_t, int16_t, int16_t, uint16_t) {}
+  void drawXBitmap(int16_t, int16_t, const uint8_t*, int16_t, int16_t, uint16_t) {}
+  void drawRGBBitmap(int16_t, int16_t, const uint16_t*, int16_t, int16_t) {}
+  int16_t width() const { return width_; }
+  int16_t height() const { return height_; }
+
+ private:
+  int16_t width_;
+  int16_t height_;
+};
+
+class GFXcanvas16 : public Adafruit_GFX {
+ public:
+  GFXcanvas16(uint16_t w, uint16_t h) : Adafruit_GFX(w, h) {}
+  uint16_t* getBuffer() { return nullptr; }
+};
+
+#endif  // TOOLS_SIL_ARDUINO_ADAFRUIT_GFX_H_
@@ -0,0 +1,23 @@
+#ifndef TOOLS_SIL_ARDUINO_ADAFRUIT_ST7735_H_
+#define TOOLS_SIL_ARDUINO_ADAFRUIT_ST7735_H_
+
+#include <Adafruit_GFX.h>
+
+#define ST77XX_BLACK   0x0000
+#define ST77XX_WHITE   0xFFFF
+#define ST77XX_RED     0xF800
+#define ST77XX_GREEN   0x07E0
+#define ST77XX_BLUE    0x001F
+#define ST77XX_CYAN    0x07FF
+#define ST77XX_MAGENTA 0xF81F
+#define ST77XX_YELLOW  0xFFE0
+#define ST77XX_ORANGE  0xFC00
+#define INITR_BLACKTAB 0x02
+
+class Adafruit_ST7735 : public Adafruit_GFX {
+ public:
+  Adafruit_ST7735(int8_t /* cs */, int8_t /* dc */, int8_t /* rst */) : Adafruit_GFX(128, 160) {}
+  void initR(uint8_t) {}
+};
+
+#endif  // TOOLS_SIL_ARDUINO_ADAFRUIT_ST7735_H_
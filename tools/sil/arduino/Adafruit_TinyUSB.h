@@ -0,0 +1,24 @@
+#ifndef TOOLS_SIL_ARDUINO_ADAFRUIT_TINYUSB_H_
+#define TOOLS_SIL_ARDUINO_ADAFRUIT_TINYUSB_H_
+
+#include <Arduino.h>
+
+#define WEBUSB_URL_DEF(name, scheme, url)  static const char name[] = url
+
+// WebUSB is never connected in the simulation
+class Adafruit_USBD_WebUSB : public Stream {
+ public:
+  void setLandingPage(const void*) {}
+  void setLineStateCallback(void (*)(bool)) {}
+  bool begin() { return true; }
+  bool connected() { return false; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+};
+
+inline uint32_t tud_vendor_write_available() { return 64; }
+
+#endif  // TOOLS_SIL_ARDUINO_ADAFRUIT_TINYUSB_H_
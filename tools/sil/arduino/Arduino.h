@@ -0,0 +1,156 @@
+// Simulated Arduino core for the software-in-the-loop build (SIL_PIO).
+// Time, pins and serial ports are backed by the simulation in sim.cpp.
+#ifndef TOOLS_SIL_ARDUINO_ARDUINO_H_
+#define TOOLS_SIL_ARDUINO_ARDUINO_H_
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define A0            26
+#define A1            27
+#define A2            28
+#define A3            29
+#define LED_BUILTIN   25
+
+// Flash strings are ordinary strings on the host
+class __FlashStringHelper;
+#define PROGMEM
+#define PSTR(s)             (s)
+#define F(s)                (reinterpret_cast<const __FlashStringHelper*>(s))
+#define pgm_read_byte(p)    (*reinterpret_cast<const uint8_t*>(p))
+#define pgm_read_word(p)    (*reinterpret_cast<const uint16_t*>(p))
+#define pgm_read_dword(p)   (*reinterpret_cast<const uint32_t*>(p))
+#define pgm_read_ptr(p)     (*reinterpret_cast<void* const*>(p))
+#define strlen_P            strlen
+#define strcpy_P            strcpy
+#define strcmp_P            strcmp
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void noInterrupts();
+void interrupts();
+
+// Stands in for a hardware timer interrupt: isr runs every periodMicros of
+// sim time, also while the main loop is stalled
+void simTimerInterrupt(uint32_t periodMicros, void (*isr)());
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReadResolution(int bits);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+inline uint16_t word(uint8_t high, uint8_t low) { return (high << 8) | low; }
+
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a < b ? b : a; }
+#define constrain(x, low, high)  ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+  virtual void flush() {}
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const __FlashStringHelper* s) { return write(reinterpret_cast<const char*>(s)); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(int n) { return printf("%d", n); }
+  size_t print(unsigned int n) { return printf("%u", n); }
+  size_t print(long n) { return printf("%ld", n); }
+  size_t print(unsigned long n) { return printf("%lu", n); }
+  size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+  size_t println() { return write("\r\n"); }
+  template <class T> size_t println(T value) { return print(value) + println(); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return n > 0 ? write(reinterpret_cast<const uint8_t*>(buffer), strlen(buffer)) : 0;
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+  size_t readBytes(char* buffer, size_t length) { return readBytes(reinterpret_cast<uint8_t*>(buffer), length); }
+  // Returns what has arrived so far, the simulation doesn't wait for the timeout
+  size_t readBytes(uint8_t* buffer, size_t length) {
+    size_t n = 0;
+    while (n < length && available() > 0) buffer[n++] = read();
+    return n;
+  }
+
+ protected:
+  unsigned long timeout_ = 1000;
+};
+
+class HardwareSerial : public Stream {
+ public:
+  virtual void begin(unsigned long baud) = 0;
+};
+
+// A serial port whose input is fed by the simulation, output goes to a sink
+class SimSerial : public HardwareSerial {
+ public:
+  explicit SimSerial(const char* name) : name_(name) {}
+  void begin(unsigned long /* baud */) override {}
+  void end() {}
+  operator bool() const { return true; }
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+  const char* name() const { return name_; }
+
+ private:
+  const char* name_;
+};
+
+extern SimSerial Serial;   // Debug output, printed with a timestamp
+extern SimSerial Serial1;  // ESC telemetry, fed by the ESC model
+extern SimSerial Serial2;  // Telemetry of the second ESC, with ESC_COUNT 2
+
+#endif  // TOOLS_SIL_ARDUINO_ARDUINO_H_
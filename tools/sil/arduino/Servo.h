@@ -0,0 +1,19 @@
+#ifndef TOOLS_SIL_ARDUINO_SERVO_H_
+#define TOOLS_SIL_ARDUINO_SERVO_H_
+
+#include <Arduino.h>
+
+// ESC output, captured by the simulation. The pin picks the motor (ESC_PINS).
+class Servo {
+ public:
+  uint8_t attach(int pin);
+  void detach();
+  void writeMicroseconds(int value);
+  int readMicroseconds() const { return value_; }
+
+ private:
+  int value_ = 0;
+  int motor_ = -1;
+};
+
+#endif  // TOOLS_SIL_ARDUINO_SERVO_H_
@@ -0,0 +1,302 @@
+// Software-in-the-loop simulator: runs the controller firmware on a PC
+// against simulated hardware, driven by a scenario script.
+//
+//   sil [--cpu-scale X] [--step US] [--realtime] [--trace FILE] [--quiet] SCENARIO
+//
+// Scenario commands, one per line (# starts a comment):
+//   wait SECONDS                  let the simulation run
+//   throttle PERCENT              set the throttle pot
+//   doubleclick | longpress       press the arm button
+//   button down|up
+//   esc on|off                    connect or disconnect ESC telemetry
+//   altitude METERS
+//   stall MILLIS                  the main loop gets no CPU time, like a task that hangs.
+//                                 Timer interrupts still run.
+//   battery WATTHOURS PERCENT     pack size and state of charge
+//   esctemp CELSIUS [ESC]         heat (or cool) every ESC, or only ESC 0, 1..., to this temperature
+//   expect armed|cruising true|false
+//   expect pwm MIN MAX            range of every ESC output, in us
+//   expect watts|amps MIN MAX     battery power or current range
+//   expect limit none|current|power|temperature   throttle limit in force
+//   expect note FREQ              a note of FREQ Hz played since the last "expect note"
+//   expect interval MICROS        worst throttle loop interval since arming
+//   expect overruns TASK N        deadline overruns of throttle, esc or button
+//   expect flighttime PERCENT     estimated minutes left within PERCENT of the plant's
+//   expect flighttime unknown
+//   expect clock KHZ              CPU clock profile in use
+//
+// Exits with 1 if any expectation failed.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "sim.h"
+#include "sp140/battery.h"
+#include "sp140/clock.h"
+#include "sp140/profiler.h"
+#include "sp140/structs.h"
+#include "sp140/supervisor.h"
+#include "sp140/throttle_limit.h"
+
+// Firmware entry points and state, see sp140.cpp
+void setup();
+void loop();
+extern bool armed;
+extern volatile bool cruising;
+extern STR_LOOP_TIMING throttleTiming;
+
+#define TRACE_INTERVAL_MICROS  20000
+
+static FILE* traceFile = nullptr;
+static uint64_t nextTraceMicros = 0;
+static uint64_t loops = 0;
+static size_t checkedNotes = 0;
+static int failures = 0;
+
+static void writeTrace() {
+  if (!traceFile || simMicros() < nextTraceMicros) return;
+  nextTraceMicros = simMicros() + TRACE_INTERVAL_MICROS;
+  // The first motor, and the battery
+  const SimMotor& motor = simPlant.motors[0];
+  fprintf(traceFile, "%.3f,%.3f,%d,%d,%d,%d,%.0f,%.1f,%.2f,%.1f,%.2f\n",
+          simMicros() / 1e6, simInputs.throttle, simInputs.buttonDown, armed, cruising,
+          motor.servoMicros, motor.rpm, simPlant.amps, simPlant.volts,
+          motor.temperatureC, simPlant.wattHours);
+}
+
+// Run the firmware for a while
+static void run(double seconds) {
+  const uint64_t end = simMicros() + static_cast<uint64_t>(seconds * 1e6);
+  while (simMicros() < end) {
+    simLoopBegin();
+    loop();
+    simLoopEnd();
+    loops++;
+    writeTrace();
+  }
+}
+
+static void press(double seconds) {
+  simInputs.buttonDown = true;
+  run(seconds);
+  simInputs.buttonDown = false;
+}
+
+static void expect(bool ok, const std::string& what) {
+  if (ok) {
+    simLog("ok: %s", what.c_str());
+  } else {
+    simLog("FAILED: %s", what.c_str());
+    failures++;
+  }
+}
+
+static bool parseBool(const std::string& value) {
+  return value == "true" || value == "1" || value == "on";
+}
+
+static void runExpect(std::istringstream& args, const std::string& line) {
+  std::string what;
+  args >> what;
+  if (what == "armed" || what == "cruising") {
+    std::string value;
+    args >> value;
+    expect((what == "armed" ? armed : cruising) == parseBool(value), line);
+  } else if (what == "pwm") {
+    int min = 0, max = 0;
+    args >> min >> max;
+    // Every ESC output
+    bool ok = true;
+    std::string actual;
+    for (const SimMotor& motor : simPlant.motors) {
+      ok = ok && motor.servoMicros >= min && motor.servoMicros <= max;
+      actual += (actual.empty() ? "" : " ") + std::to_string(motor.servoMicros);
+    }
+    expect(ok, line + " (" + actual + ")");
+  } else if (what == "watts" || what == "amps") {
+    double min = 0, max = 0;
+    args >> min >> max;
+    const double value = what == "watts" ? simPlant.volts * simPlant.amps : simPlant.amps;
+    char actual[32];
+    snprintf(actual, sizeof(actual), " (%.0f)", value);
+    expect(value >= min && value <= max, line + actual);
+  } else if (what == "limit") {
+    std::string reason;
+    args >> reason;
+    const STR_THROTTLE_LIMIT& limit = getThrottleLimit();
+    const uint8_t flag = reason == "current" ? LIMIT_CURRENT : reason == "power" ? LIMIT_POWER :
+                         reason == "temperature" ? LIMIT_TEMPERATURE : 0;
+    const bool ok = flag == 0 ? limit.active == 0 : (limit.active & flag) != 0;
+    expect(ok, line + " (cap " + std::to_string(limit.capPermille) + ", flags " + std::to_string(limit.active) + ")");
+  } else if (what == "note") {
+    unsigned int freq = 0;
+    args >> freq;
+    bool found = false;
+    for (; checkedNotes < simNotes.size(); checkedNotes++) {
+      if (simNotes[checkedNotes].freq == freq) found = true;
+    }
+    expect(found, line);
+  } else if (what == "overruns") {
+    std::string task;
+    uint32_t count = 0;
+    args >> task >> count;
+    const uint8_t id = task == "throttle" ? SUPERVISED_THROTTLE : task == "esc" ? SUPERVISED_ESC : SUPERVISED_BUTTON;
+    const uint32_t overruns = getTaskDeadlineStats(id).overruns;
+    expect(overruns == count, line + " (" + std::to_string(overruns) + ")");
+  } else if (what == "flighttime") {
+    // Against the plant: energy left to 0% charge at the present power,
+    // within PERCENT or a minute (the estimate is in whole minutes)
+    std::string value;
+    args >> value;
+    const uint16_t minutes = getFlightTimeEstimate().minutes;
+    const std::string got = minutes == FLIGHT_TIME_UNKNOWN ? "unknown" : std::to_string(minutes);
+    if (value == "unknown") {
+      expect(minutes == FLIGHT_TIME_UNKNOWN, line + " (" + got + ")");
+      return;
+    }
+    const double percent = atof(value.c_str());
+    const double watts = simPlant.volts * simPlant.amps;
+    const double truth = watts > 0 ? (simOptions.batteryWattHours - simPlant.wattHours) * 60 / watts : 0;
+    const double tolerance = fmax(truth * percent / 100, 1);
+    char actual[64];
+    snprintf(actual, sizeof(actual), " (%s, plant %.1f)", got.c_str(), truth);
+    expect(minutes != FLIGHT_TIME_UNKNOWN && fabs(minutes - truth) <= tolerance, line + actual);
+  } else if (what == "clock") {
+    uint32_t khz = 0;
+    args >> khz;
+    expect(getCpuKhz() == khz, line + " (" + std::to_string(getCpuKhz()) + ")");
+  } else if (what == "interval") {
+    uint32_t max = 0;
+    args >> max;
+    expect(throttleTiming.maxIntervalMicros <= max,
+           line + " (" + std::to_string(throttleTiming.maxIntervalMicros) + ")");
+  } else {
+    expect(false, "unknown expectation: " + line);
+  }
+}
+
+static bool runScenario(std::istream& in) {
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(in, line)) {
+    lineNumber++;
+    const size_t comment = line.find('#');
+    if (comment != std::string::npos) line.erase(comment);
+    std::istringstream args(line);
+    std::string command;
+    if (!(args >> command)) continue;
+
+    if (command == "wait") {
+      double seconds = 0;
+      args >> seconds;
+      run(seconds);
+    } else if (command == "throttle") {
+      double percent = 0;
+      args >> percent;
+      simInputs.throttle = percent / 100;
+    } else if (command == "doubleclick") {
+      press(0.05);
+      run(0.1);
+      press(0.05);
+      run(0.7);  // Past the double click delay
+    } else if (command == "longpress") {
+      press(3);
+      run(0.1);
+    } else if (command == "button") {
+      std::string state;
+      args >> state;
+      simInputs.buttonDown = state == "down";
+    } else if (command == "esc") {
+      std::string state;
+      args >> state;
+      simInputs.escConnected = parseBool(state);
+    } else if (command == "stall") {
+      double millis = 0;
+      args >> millis;
+      simAdvance(static_cast<uint64_t>(millis * 1000));
+    } else if (command == "battery") {
+      double wattHours = 0, percent = 0;
+      args >> wattHours >> percent;
+      simOptions.batteryWattHours = wattHours;
+      simPlant.wattHours = wattHours * (1 - percent / 100);
+    } else if (command == "esctemp") {
+      float celsius = 0;
+      int esc = -1;
+      args >> celsius >> esc;
+      for (int i = 0; i < ESC_COUNT; i++) {
+        if (esc < 0 || esc == i) simPlant.motors[i].temperatureC = celsius;
+      }
+    } else if (command == "altitude") {
+      args >> simInputs.altitude;
+    } else if (command == "expect") {
+      runExpect(args, line);
+    } else {
+      fprintf(stderr, "line %d: unknown command \"%s\"\n", lineNumber, command.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static int usage() {
+  fprintf(stderr, "usage: sil [--cpu-scale X] [--step US] [--realtime] [--trace FILE] [--quiet] SCENARIO\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  const char* scenarioPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (arg == "--cpu-scale" && hasValue) {
+      simOptions.cpuScale = atof(argv[++i]);
+    } else if (arg == "--step" && hasValue) {
+      simOptions.idleStepMicros = atoi(argv[++i]);
+    } else if (arg == "--realtime") {
+      simOptions.realtime = true;
+    } else if (arg == "--trace" && hasValue) {
+      traceFile = fopen(argv[++i], "w");
+      if (!traceFile) {
+        perror(argv[i]);
+        return 2;
+      }
+      fprintf(traceFile, "seconds,throttle,button,armed,cruising,pwm,rpm,amps,volts,temperature,watt_hours\n");
+    } else if (arg == "--quiet") {
+      simOptions.quiet = true;
+    } else if (arg[0] != '-' || arg == "-") {
+      scenarioPath = argv[i];
+    } else {
+      return usage();
+    }
+  }
+  if (!scenarioPath) return usage();
+
+  std::ifstream file;
+  if (std::string(scenarioPath) != "-") {
+    file.open(scenarioPath);
+    if (!file) {
+      perror(scenarioPath);
+      return 2;
+    }
+  }
+  std::istream& scenario = file.is_open() ? file : std::cin;
+
+  simLoopBegin();
+  setup();
+  simLoopEnd();
+  const bool ok = runScenario(scenario);
+  if (traceFile) fclose(traceFile);
+
+  simLog("%llu loops, %u ESC packets, %zu notes, %.1f Wh used, peak load %.1f%%, lowest idle %.1f%%, %d failed",
+         static_cast<unsigned long long>(loops), static_cast<unsigned int>(simPlant.escPackets),
+         simNotes.size(), simPlant.wattHours, getCpuLoad().peakBusyPermille[0] / 10.0,
+         getCpuLoad().minIdlePermille / 10.0, failures);
+  if (!ok) return 2;
+  return failures > 0 ? 1 : 0;
+}
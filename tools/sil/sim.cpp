@@ -0,0 +1,367 @@
+// Fake Arduino core and hardware models for the software-in-the-loop build
+
+#include "sim.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+#include "sp140/buzzer.h"
+#include "sp140/config.h"
+#include "sp140/structs.h"
+
+#include <Adafruit_BMP3XX.h>
+#include <Adafruit_DRV2605.h>
+#include <Arduino.h>
+#include <Servo.h>
+
+#define ESC_PACKET_MICROS    20000  // The ESC sends telemetry at 50 Hz
+#define PLANT_STEP_MICROS    1000
+
+// Motor and battery model, roughly an SP140 on a 24S pack
+#define MOTOR_MAX_RPM        5800
+#define MOTOR_MAX_WATTS      18000
+#define MOTOR_SPIN_UP_S      0.25   // time constant
+#define BATTERY_OHMS         0.04
+#define ESC_HEAT_PER_AMP2    0.002  // steady state C above ambient per A^2
+#define ESC_THERMAL_S        60     // time constant
+#define AMBIENT_C            25
+
+#pragma pack(push, 1)
+// Same layout as the v2 packet parsed in esc_telemetry.cpp
+typedef struct {
+  uint16_t rawVolts;
+  uint16_t rawTemperature;
+  int16_t rawAmps;
+  uint16_t R0;
+  uint32_t rawRpm;
+  uint16_t dutyIn;
+  uint16_t dutyOut;
+  uint8_t statusFlag;
+  uint8_t R1;
+  uint16_t checksum;
+  uint16_t stopBytes;
+} SIM_ESC_PACKET;
+#pragma pack(pop)
+
+SimInputs simInputs;
+SimPlant simPlant;
+SimOptions simOptions;
+std::vector<SimNote> simNotes;
+
+SimSerial Serial("Serial");
+SimSerial Serial1("Serial1");
+SimSerial Serial2("Serial2");
+
+static uint64_t clockMicros = 0;
+static uint64_t nextPlantMicros = 0;
+static uint64_t nextEscMicros = ESC_PACKET_MICROS / ESC_COUNT;
+static uint8_t nextEsc = 0;  // The ESCs take turns, out of step with each other
+static uint64_t noteEndMicros = 0;
+static uint32_t timerPeriodMicros = 0;  // simTimerInterrupt(), 0 = none
+static uint64_t nextTimerMicros = 0;
+static void (*timerIsr)() = nullptr;
+static bool inLoop = false;
+static uint64_t loopStartNanos = 0;
+static const std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+static SimSerial* const kEscSerials[] = ESC_SERIALS;
+static const uint8_t kEscPins[] = ESC_PINS;
+static std::deque<uint8_t> escRx[ESC_COUNT];  // Input of each ESC's serial port
+static std::string serialLine;     // Serial output, printed a line at a time
+static int pinState[64];
+
+//
+// Clock
+//
+
+// CPU time of this thread, so host preemption isn't charged to the firmware
+static uint64_t threadCpuNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Host CPU time spent in the current loop() call, as sim micros
+static uint64_t loopCpuMicros() {
+  if (!inLoop || simOptions.cpuScale <= 0) return 0;
+  return static_cast<uint64_t>((threadCpuNanos() - loopStartNanos) / 1000.0 * simOptions.cpuScale);
+}
+
+uint64_t simMicros() {
+  return clockMicros + loopCpuMicros();
+}
+
+void simLog(const char* format, ...) {
+  const uint64_t now = simMicros();
+  printf("[%7u.%03u] ", static_cast<unsigned int>(now / 1000000), static_cast<unsigned int>(now / 1000 % 1000));
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+  putchar('\n');
+}
+
+//
+// Models
+//
+
+static uint16_t fletcher16(const uint8_t* buffer, int len) {
+  uint16_t c0 = 0;
+  uint16_t c1 = 0;
+  for (int i = 0; i < len; ++i) {
+    c0 = (c0 + buffer[i]) % 255;
+    c1 = (c1 + c0) % 255;
+  }
+  return (c1 << 8) | c0;
+}
+
+// Open circuit voltage at 0, 10, ... 100% charge, the data points the
+// firmware's battery model uses (see battery.cpp)
+static const float kOpenCircuitVolts[] = {60.96, 78, 80.16, 82.32, 85.2, 87.6, 89.76, 91.68, 93.36, 94.8, 99.6};
+
+static float openCircuitVolts(float charge) {
+  const float position = constrain(charge, 0.0f, 1.0f) * 10;
+  const int i = min(static_cast<int>(position), 9);
+  return kOpenCircuitVolts[i] + (kOpenCircuitVolts[i + 1] - kOpenCircuitVolts[i]) * (position - i);
+}
+
+static float throttleFraction(const SimMotor& motor) {
+  const int pwm = motor.servoMicros;
+  if (pwm < 1030) return 0;  // Disarmed
+  return constrain((pwm - 1030) / 960.0f, 0.0f, 1.0f);
+}
+
+static void stepPlant(float dt) {
+  float motorWatts[ESC_COUNT];
+  float watts = 0;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    SimMotor& motor = simPlant.motors[i];
+    const float targetRpm = throttleFraction(motor) * MOTOR_MAX_RPM;
+    motor.rpm += (targetRpm - motor.rpm) * fminf(dt / MOTOR_SPIN_UP_S, 1);
+    const float load = motor.rpm / MOTOR_MAX_RPM;
+    motorWatts[i] = MOTOR_MAX_WATTS * load * load * load;
+    watts += motorWatts[i];
+  }
+
+  const float charge = fmaxf(1 - simPlant.wattHours / simOptions.batteryWattHours, 0);
+  const float restVolts = openCircuitVolts(charge);
+  simPlant.amps = watts / restVolts;
+  simPlant.volts = restVolts - simPlant.amps * BATTERY_OHMS;
+  simPlant.wattHours += simPlant.volts * simPlant.amps * dt / 3600;
+
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    SimMotor& motor = simPlant.motors[i];
+    motor.amps = motorWatts[i] / restVolts;
+    const float targetC = AMBIENT_C + motor.amps * motor.amps * ESC_HEAT_PER_AMP2;
+    motor.temperatureC += (targetC - motor.temperatureC) * fminf(dt / ESC_THERMAL_S, 1);
+  }
+}
+
+// Encode the state of a motor the way its ESC reports it, see parseEscSerialData()
+static void sendEscPacket(uint8_t esc) {
+  const SimMotor& motor = simPlant.motors[esc];
+  SIM_ESC_PACKET packet = {};
+  const float volts = simPlant.volts > 61.5f ? simPlant.volts - 1.5f : simPlant.volts;  // Undo the calibration offset
+  packet.rawVolts = lroundf(volts * 100);
+  const float ntcOhms = 10000 * expf(3455 * (1 / (motor.temperatureC + 273.15f) - 1 / 298.15f));
+  packet.rawTemperature = lroundf(4096 / (10000 / ntcOhms + 1));
+  packet.rawAmps = lroundf(motor.amps * 12.5f);
+  packet.rawRpm = lroundf(motor.rpm * 62);
+  packet.dutyIn = lroundf(throttleFraction(motor) * 10000);
+  packet.dutyOut = packet.dutyIn;
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(&packet);
+  packet.checksum = fletcher16(bytes, sizeof(packet) - 4);
+  packet.stopBytes = 0xFFFF;
+  escRx[esc].insert(escRx[esc].end(), bytes, bytes + sizeof(packet));
+  simPlant.escPackets++;
+}
+
+// The ESC whose telemetry arrives on a serial port, or -1
+static int escOfSerial(const SimSerial* serial) {
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if (kEscSerials[i] == serial) return i;
+  }
+  return -1;
+}
+
+// Plays queued notes like core1 does on the RP2040
+static void playNotes() {
+  STR_NOTE note;
+  while (clockMicros >= noteEndMicros && popBuzzerNote(&note)) {
+    const uint64_t start = noteEndMicros > 0 ? noteEndMicros : clockMicros;
+    simNotes.push_back({start, note.f.freq, note.f.duration});
+    if (!simOptions.quiet) simLog("buzzer %u Hz %u ms", note.f.freq, note.f.duration);
+    noteEndMicros = start + note.f.duration * 1000ull;
+  }
+  if (clockMicros >= noteEndMicros) noteEndMicros = 0;
+}
+
+void simAdvance(uint64_t micros) {
+  const uint64_t end = clockMicros + micros;
+  while (clockMicros < end) {
+    uint64_t next = end;
+    if (nextPlantMicros < next) next = nextPlantMicros;
+    if (nextEscMicros < next) next = nextEscMicros;
+    if (noteEndMicros > clockMicros && noteEndMicros < next) next = noteEndMicros;
+    if (timerIsr && nextTimerMicros < next) next = nextTimerMicros;
+    clockMicros = next;
+
+    if (clockMicros >= nextPlantMicros) {
+      stepPlant(PLANT_STEP_MICROS / 1e6f);
+      nextPlantMicros += PLANT_STEP_MICROS;
+    }
+    if (clockMicros >= nextEscMicros) {
+      if (simInputs.escConnected) sendEscPacket(nextEsc);
+      nextEsc = (nextEsc + 1) % ESC_COUNT;
+      nextEscMicros += ESC_PACKET_MICROS / ESC_COUNT;
+    }
+    playNotes();
+    if (timerIsr && clockMicros >= nextTimerMicros) {
+      nextTimerMicros += timerPeriodMicros;
+      timerIsr();
+    }
+  }
+
+  if (simOptions.realtime) {
+    std::this_thread::sleep_until(wallStart + std::chrono::microseconds(clockMicros));
+  }
+}
+
+void simLoopBegin() {
+  playNotes();  // Notes queued outside of loop(), e.g. in setup()
+  inLoop = true;
+  loopStartNanos = threadCpuNanos();
+}
+
+void simLoopEnd() {
+  const uint64_t cpuMicros = loopCpuMicros();
+  inLoop = false;
+  simAdvance(cpuMicros + simOptions.idleStepMicros);
+}
+
+//
+// Arduino core
+//
+
+unsigned long millis() { return simMicros() / 1000; }
+unsigned long micros() { return simMicros(); }
+
+void delay(unsigned long ms) {
+  // Charge the time so far in this loop, then the delay itself
+  const uint64_t cpuMicros = loopCpuMicros();
+  simAdvance(cpuMicros + ms * 1000ull);
+  if (inLoop) loopStartNanos = threadCpuNanos();
+}
+
+void delayMicroseconds(unsigned int us) { simAdvance(us); }
+void yield() {}
+void noInterrupts() {}
+void interrupts() {}
+
+void simTimerInterrupt(uint32_t periodMicros, void (*isr)()) {
+  timerPeriodMicros = periodMicros;
+  nextTimerMicros = clockMicros + periodMicros;
+  timerIsr = isr;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < 64 && mode == INPUT_PULLUP) pinState[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < 64) pinState[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin == BUTTON_TOP) return simInputs.buttonDown ? LOW : HIGH;  // Pulled up, pressed is low
+  return pin < 64 ? pinState[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  if (pin == THROTTLE_PIN) return lroundf(constrain(simInputs.throttle, 0.0f, 1.0f) * 4095);
+  return 0;
+}
+
+void analogReadResolution(int /* bits */) {}
+void tone(uint8_t /* pin */, unsigned int /* frequency */, unsigned long /* duration */) {}
+void noTone(uint8_t /* pin */) {}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return min + random(max - min); }
+void randomSeed(unsigned long seed) { srand(seed); }
+
+int SimSerial::available() {
+  const int esc = escOfSerial(this);
+  return esc >= 0 ? static_cast<int>(escRx[esc].size()) : 0;
+}
+
+int SimSerial::read() {
+  const int esc = escOfSerial(this);
+  if (esc < 0 || escRx[esc].empty()) return -1;
+  const uint8_t c = escRx[esc].front();
+  escRx[esc].pop_front();
+  return c;
+}
+
+int SimSerial::peek() {
+  const int esc = escOfSerial(this);
+  return esc >= 0 && !escRx[esc].empty() ? escRx[esc].front() : -1;
+}
+
+size_t SimSerial::write(uint8_t c) {
+  if (this != &Serial) return 1;  // Nothing listens to the ESC
+  if (c == '\n') {
+    if (!simOptions.quiet) simLog("%s", serialLine.c_str());
+    serialLine.clear();
+  } else if (c != '\r') {
+    serialLine += static_cast<char>(c);
+  }
+  return 1;
+}
+
+size_t SimSerial::write(const uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) write(buffer[i]);
+  return size;
+}
+
+//
+// Peripherals
+//
+
+uint8_t Servo::attach(int pin) {
+  motor_ = -1;
+  for (uint8_t i = 0; i < ESC_COUNT; i++) {
+    if (kEscPins[i] == pin) motor_ = i;
+  }
+  return 0;
+}
+
+void Servo::detach() {
+  value_ = 0;
+  if (motor_ >= 0) simPlant.motors[motor_].servoMicros = 0;  // No pulses
+}
+
+void Servo::writeMicroseconds(int value) {
+  value_ = value;
+  if (motor_ >= 0) simPlant.motors[motor_].servoMicros = value;
+}
+
+bool Adafruit_BMP3XX::begin_I2C() { return true; }
+
+float Adafruit_BMP3XX::readAltitude(float /* seaLevel */) {
+  return 100 + simInputs.altitude;  // The field isn't at sea level
+}
+
+void Adafruit_DRV2605::go() {
+  if (!simOptions.quiet) simLog("vibrate %u", waveforms_[0]);
+}
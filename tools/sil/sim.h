@@ -0,0 +1,75 @@
+// Simulated hardware for the software-in-the-loop build.
+//
+// The firmware runs unmodified against the fake Arduino core in arduino/.
+// Time only moves when the simulation advances it, so runs are repeatable.
+// Between calls to loop() the clock advances by an idle step, plus the host
+// CPU time spent in loop() scaled by --cpu-scale to stand in for the real CPU.
+
+#ifndef TOOLS_SIL_SIM_H_
+#define TOOLS_SIL_SIM_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "sp140/config.h"
+
+// Inputs, set by the scenario
+struct SimInputs {
+  float throttle = 0;         // pot position, 0..1
+  bool buttonDown = false;
+  bool escConnected = true;   // ESC sends telemetry
+  float altitude = 0;         // m above the ground
+};
+
+// A motor and its ESC, driven by one servo output
+struct SimMotor {
+  int servoMicros = 0;
+  float rpm = 0;
+  float amps = 0;             // through this ESC
+  float temperatureC = 25;
+};
+
+// Battery and ESC_COUNT motors, each ESC sending its own telemetry
+struct SimPlant {
+  SimMotor motors[ESC_COUNT];
+  float amps = 0;             // from the battery, all ESCs
+  float volts = 0;
+  float wattHours = 0;        // drawn from the battery so far
+  uint32_t escPackets = 0;
+};
+
+// A buzzer note, logged when it starts playing
+struct SimNote {
+  uint64_t startMicros;
+  uint16_t freq;
+  uint16_t duration;
+};
+
+struct SimOptions {
+  float cpuScale = 0;          // host CPU time in loop() x this, added to the sim clock
+  uint32_t idleStepMicros = 100;
+  bool realtime = false;       // keep the sim clock in step with the wall clock
+  float batteryWattHours = 4000;
+  bool quiet = false;          // don't print debug serial output
+};
+
+extern SimInputs simInputs;
+extern SimPlant simPlant;
+extern SimOptions simOptions;
+extern std::vector<SimNote> simNotes;
+
+uint64_t simMicros();
+
+// Advance the clock, running the models for the elapsed time
+void simAdvance(uint64_t micros);
+
+// Bracket a call to loop(), to charge its host CPU time to the sim clock
+void simLoopBegin();
+void simLoopEnd();
+
+// Print a line prefixed with the sim time
+void simLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif  // TOOLS_SIL_SIM_H_